@@ -280,12 +280,14 @@ get_bbox(ge_GIF *gif, uint16_t *w, uint16_t *h, uint16_t *x, uint16_t *y)
 }
 
 static void
-add_graphics_control_extension(ge_GIF *gif, uint16_t d)
+add_graphics_control_extension(ge_GIF *gif, uint16_t d, int disposal)
 {
-    uint8_t flags = ((gif->bgindex >= 0 ? 2 : 1) << 2) + 1;
+    /* the transparency flag is only set with a transparent index */
+    uint8_t flags = ((disposal & 7) << 2) | (gif->bgindex >= 0 ? 1 : 0);
     write(gif->fd, (uint8_t []) {'!', 0xF9, 0x04, flags}, 4);
     write_num(gif->fd, d);
-    write(gif->fd, (uint8_t []) {(uint8_t) gif->bgindex, 0x00}, 2);
+    write(gif->fd, (uint8_t []) {
+      (uint8_t) (gif->bgindex >= 0 ? gif->bgindex : 0), 0x00}, 2);
 }
 
 void
@@ -295,7 +297,7 @@ ge_add_frame(ge_GIF *gif, uint16_t delay)
     uint8_t *tmp;
 
     if (delay || (gif->bgindex >= 0))
-        add_graphics_control_extension(gif, delay);
+        add_graphics_control_extension(gif, delay, gif->bgindex >= 0 ? 2 : 1);
     if (gif->nframes == 0) {
         w = gif->w;
         h = gif->h;
@@ -314,6 +316,19 @@ ge_add_frame(ge_GIF *gif, uint16_t delay)
     }
 }
 
+/* Add a sub-image of frame, bgindex (if any) is the transparent index.
+ *   disposal 1 keeps the sub-image, 2 restores it to the background */
+void
+ge_add_frame_rect(
+    ge_GIF *gif, uint16_t delay,
+    uint16_t x, uint16_t y, uint16_t w, uint16_t h, int disposal
+)
+{
+    add_graphics_control_extension(gif, delay, disposal);
+    put_image(gif, w, h, x, y);
+    gif->nframes++;
+}
+
 void
 ge_close_gif(ge_GIF* gif)
 {
@@ -375,6 +375,20 @@ STBIRDEF int stbir_resize_region(  const void *input_pixels , int input_w , int
                                    float s0, float t0, float s1, float t1);
 // (s0, t0) & (s1, t1) are the top-left and bottom right corner (uv addressing style: [0, 1]x[0, 1]) of a region of the input image to use.
 
+// spright: like stbir_resize_subpixel, but input_pixels only contains the
+// rows of the input image starting at input_first_row, which must contain
+// all rows within the filter support of the output rows
+STBIRDEF int stbir_resize_subpixel_rows(const void *input_pixels , int input_w , int input_h , int input_stride_in_bytes,
+                                         void *output_pixels, int output_w, int output_h, int output_stride_in_bytes,
+                                   stbir_datatype datatype,
+                                   int num_channels, int alpha_channel, int flags,
+                                   stbir_edge edge_mode_horizontal, stbir_edge edge_mode_vertical,
+                                   stbir_filter filter_horizontal,  stbir_filter filter_vertical,
+                                   stbir_colorspace space, void *alloc_context,
+                                   float x_scale, float y_scale,
+                                   float x_offset, float y_offset,
+                                   int input_first_row);
+
 //
 //
 ////   end header file   /////////////////////////////////////////////////////
@@ -495,6 +509,7 @@ typedef struct
     int input_w;
     int input_h;
     int input_stride_bytes;
+    int input_first_row; // spright: row of the input image at input_data
 
     void* output_data;
     int output_w;
@@ -1261,7 +1276,7 @@ static void stbir__decode_scanline(stbir__info* stbir_info, int n)
     float* decode_buffer = stbir__get_decode_buffer(stbir_info);
     stbir_edge edge_horizontal = stbir_info->edge_horizontal;
     stbir_edge edge_vertical = stbir_info->edge_vertical;
-    size_t in_buffer_row_offset = stbir__edge_wrap(edge_vertical, n, stbir_info->input_h) * input_stride_bytes;
+    size_t in_buffer_row_offset = (stbir__edge_wrap(edge_vertical, n, stbir_info->input_h) - stbir_info->input_first_row) * input_stride_bytes;
     const void* input_data = (char *) stbir_info->input_data + in_buffer_row_offset;
     int max_x = input_w + stbir_info->horizontal_filter_pixel_margin;
     int decode = STBIR__DECODE(type, colorspace);
@@ -2207,6 +2222,7 @@ static void stbir__setup(stbir__info *info, int input_w, int input_h, int output
 {
     info->input_w = input_w;
     info->input_h = input_h;
+    info->input_first_row = 0;
     info->output_w = output_w;
     info->output_h = output_h;
     info->channels = channels;
@@ -2432,7 +2448,8 @@ static int stbir__resize_arbitrary(
     float s0, float t0, float s1, float t1, float *transform,
     int channels, int alpha_channel, stbir_uint32 flags, stbir_datatype type,
     stbir_filter h_filter, stbir_filter v_filter,
-    stbir_edge edge_horizontal, stbir_edge edge_vertical, stbir_colorspace colorspace)
+    stbir_edge edge_horizontal, stbir_edge edge_vertical, stbir_colorspace colorspace,
+    int input_first_row)
 {
     stbir__info info;
     int result;
@@ -2440,6 +2457,7 @@ static int stbir__resize_arbitrary(
     void* extra_memory;
 
     stbir__setup(&info, input_w, input_h, output_w, output_h, channels);
+    info.input_first_row = input_first_row;
     stbir__calculate_transform(&info, s0,t0,s1,t1,transform);
     stbir__choose_filter(&info, h_filter, v_filter);
     memory_required = stbir__calculate_memory(&info);
@@ -2466,7 +2484,7 @@ STBIRDEF int stbir_resize_uint8(     const unsigned char *input_pixels , int inp
     return stbir__resize_arbitrary(NULL, input_pixels, input_w, input_h, input_stride_in_bytes,
         output_pixels, output_w, output_h, output_stride_in_bytes,
         0,0,1,1,NULL,num_channels,-1,0, STBIR_TYPE_UINT8, STBIR_FILTER_DEFAULT, STBIR_FILTER_DEFAULT,
-        STBIR_EDGE_CLAMP, STBIR_EDGE_CLAMP, STBIR_COLORSPACE_LINEAR);
+        STBIR_EDGE_CLAMP, STBIR_EDGE_CLAMP, STBIR_COLORSPACE_LINEAR, 0);
 }
 
 STBIRDEF int stbir_resize_float(     const float *input_pixels , int input_w , int input_h , int input_stride_in_bytes,
@@ -2476,7 +2494,7 @@ STBIRDEF int stbir_resize_float(     const float *input_pixels , int input_w , i
     return stbir__resize_arbitrary(NULL, input_pixels, input_w, input_h, input_stride_in_bytes,
         output_pixels, output_w, output_h, output_stride_in_bytes,
         0,0,1,1,NULL,num_channels,-1,0, STBIR_TYPE_FLOAT, STBIR_FILTER_DEFAULT, STBIR_FILTER_DEFAULT,
-        STBIR_EDGE_CLAMP, STBIR_EDGE_CLAMP, STBIR_COLORSPACE_LINEAR);
+        STBIR_EDGE_CLAMP, STBIR_EDGE_CLAMP, STBIR_COLORSPACE_LINEAR, 0);
 }
 
 STBIRDEF int stbir_resize_uint8_srgb(const unsigned char *input_pixels , int input_w , int input_h , int input_stride_in_bytes,
@@ -2486,7 +2504,7 @@ STBIRDEF int stbir_resize_uint8_srgb(const unsigned char *input_pixels , int inp
     return stbir__resize_arbitrary(NULL, input_pixels, input_w, input_h, input_stride_in_bytes,
         output_pixels, output_w, output_h, output_stride_in_bytes,
         0,0,1,1,NULL,num_channels,alpha_channel,flags, STBIR_TYPE_UINT8, STBIR_FILTER_DEFAULT, STBIR_FILTER_DEFAULT,
-        STBIR_EDGE_CLAMP, STBIR_EDGE_CLAMP, STBIR_COLORSPACE_SRGB);
+        STBIR_EDGE_CLAMP, STBIR_EDGE_CLAMP, STBIR_COLORSPACE_SRGB, 0);
 }
 
 STBIRDEF int stbir_resize_uint8_srgb_edgemode(const unsigned char *input_pixels , int input_w , int input_h , int input_stride_in_bytes,
@@ -2497,7 +2515,7 @@ STBIRDEF int stbir_resize_uint8_srgb_edgemode(const unsigned char *input_pixels
     return stbir__resize_arbitrary(NULL, input_pixels, input_w, input_h, input_stride_in_bytes,
         output_pixels, output_w, output_h, output_stride_in_bytes,
         0,0,1,1,NULL,num_channels,alpha_channel,flags, STBIR_TYPE_UINT8, STBIR_FILTER_DEFAULT, STBIR_FILTER_DEFAULT,
-        edge_wrap_mode, edge_wrap_mode, STBIR_COLORSPACE_SRGB);
+        edge_wrap_mode, edge_wrap_mode, STBIR_COLORSPACE_SRGB, 0);
 }
 
 STBIRDEF int stbir_resize_uint8_generic( const unsigned char *input_pixels , int input_w , int input_h , int input_stride_in_bytes,
@@ -2509,7 +2527,7 @@ STBIRDEF int stbir_resize_uint8_generic( const unsigned char *input_pixels , int
     return stbir__resize_arbitrary(alloc_context, input_pixels, input_w, input_h, input_stride_in_bytes,
         output_pixels, output_w, output_h, output_stride_in_bytes,
         0,0,1,1,NULL,num_channels,alpha_channel,flags, STBIR_TYPE_UINT8, filter, filter,
-        edge_wrap_mode, edge_wrap_mode, space);
+        edge_wrap_mode, edge_wrap_mode, space, 0);
 }
 
 STBIRDEF int stbir_resize_uint16_generic(const stbir_uint16 *input_pixels  , int input_w , int input_h , int input_stride_in_bytes,
@@ -2521,7 +2539,7 @@ STBIRDEF int stbir_resize_uint16_generic(const stbir_uint16 *input_pixels  , int
     return stbir__resize_arbitrary(alloc_context, input_pixels, input_w, input_h, input_stride_in_bytes,
         output_pixels, output_w, output_h, output_stride_in_bytes,
         0,0,1,1,NULL,num_channels,alpha_channel,flags, STBIR_TYPE_UINT16, filter, filter,
-        edge_wrap_mode, edge_wrap_mode, space);
+        edge_wrap_mode, edge_wrap_mode, space, 0);
 }
 
 
@@ -2534,7 +2552,7 @@ STBIRDEF int stbir_resize_float_generic( const float *input_pixels         , int
     return stbir__resize_arbitrary(alloc_context, input_pixels, input_w, input_h, input_stride_in_bytes,
         output_pixels, output_w, output_h, output_stride_in_bytes,
         0,0,1,1,NULL,num_channels,alpha_channel,flags, STBIR_TYPE_FLOAT, filter, filter,
-        edge_wrap_mode, edge_wrap_mode, space);
+        edge_wrap_mode, edge_wrap_mode, space, 0);
 }
 
 
@@ -2549,7 +2567,7 @@ STBIRDEF int stbir_resize(         const void *input_pixels , int input_w , int
     return stbir__resize_arbitrary(alloc_context, input_pixels, input_w, input_h, input_stride_in_bytes,
         output_pixels, output_w, output_h, output_stride_in_bytes,
         0,0,1,1,NULL,num_channels,alpha_channel,flags, datatype, filter_horizontal, filter_vertical,
-        edge_mode_horizontal, edge_mode_vertical, space);
+        edge_mode_horizontal, edge_mode_vertical, space, 0);
 }
 
 
@@ -2571,7 +2589,7 @@ STBIRDEF int stbir_resize_subpixel(const void *input_pixels , int input_w , int
     return stbir__resize_arbitrary(alloc_context, input_pixels, input_w, input_h, input_stride_in_bytes,
         output_pixels, output_w, output_h, output_stride_in_bytes,
         0,0,1,1,transform,num_channels,alpha_channel,flags, datatype, filter_horizontal, filter_vertical,
-        edge_mode_horizontal, edge_mode_vertical, space);
+        edge_mode_horizontal, edge_mode_vertical, space, 0);
 }
 
 STBIRDEF int stbir_resize_region(  const void *input_pixels , int input_w , int input_h , int input_stride_in_bytes,
@@ -2586,7 +2604,29 @@ STBIRDEF int stbir_resize_region(  const void *input_pixels , int input_w , int
     return stbir__resize_arbitrary(alloc_context, input_pixels, input_w, input_h, input_stride_in_bytes,
         output_pixels, output_w, output_h, output_stride_in_bytes,
         s0,t0,s1,t1,NULL,num_channels,alpha_channel,flags, datatype, filter_horizontal, filter_vertical,
-        edge_mode_horizontal, edge_mode_vertical, space);
+        edge_mode_horizontal, edge_mode_vertical, space, 0);
+}
+
+STBIRDEF int stbir_resize_subpixel_rows(const void *input_pixels , int input_w , int input_h , int input_stride_in_bytes,
+                                         void *output_pixels, int output_w, int output_h, int output_stride_in_bytes,
+                                   stbir_datatype datatype,
+                                   int num_channels, int alpha_channel, int flags,
+                                   stbir_edge edge_mode_horizontal, stbir_edge edge_mode_vertical,
+                                   stbir_filter filter_horizontal,  stbir_filter filter_vertical,
+                                   stbir_colorspace space, void *alloc_context,
+                                   float x_scale, float y_scale,
+                                   float x_offset, float y_offset,
+                                   int input_first_row)
+{
+    float transform[4];
+    transform[0] = x_scale;
+    transform[1] = y_scale;
+    transform[2] = x_offset;
+    transform[3] = y_offset;
+    return stbir__resize_arbitrary(alloc_context, input_pixels, input_w, input_h, input_stride_in_bytes,
+        output_pixels, output_w, output_h, output_stride_in_bytes,
+        0,0,1,1,transform,num_channels,alpha_channel,flags, datatype, filter_horizontal, filter_vertical,
+        edge_mode_horizontal, edge_mode_vertical, space, input_first_row);
 }
 
 #endif // STB_IMAGE_RESIZE_IMPLEMENTATION
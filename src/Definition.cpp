@@ -66,8 +66,13 @@ std::string_view get_definition_name(Definition definition) {
     case Definition::duplicates: return "duplicates";
     case Definition::alpha: return "alpha";
     case Definition::pack: return "pack";
+    case Definition::pack_effort: return "pack-effort";
+    case Definition::incremental: return "incremental";
     case Definition::scale: return "scale";
     case Definition::debug: return "debug";
+    case Definition::compression: return "compression";
+    case Definition::encoding: return "encoding";
+    case Definition::mipmaps: return "mipmaps";
     case Definition::path: return "path";
     case Definition::glob: return "glob";
     case Definition::input: return "input";
@@ -136,11 +141,16 @@ Definition get_affected_definition(Definition definition) {
     case Definition::padding:
     case Definition::duplicates:
     case Definition::pack:
+    case Definition::pack_effort:
+    case Definition::incremental:
       return Definition::sheet;
 
     case Definition::alpha:
     case Definition::scale:
     case Definition::debug:
+    case Definition::compression:
+    case Definition::encoding:
+    case Definition::mipmaps:
       return Definition::output;
 
     case Definition::path:
@@ -385,6 +395,11 @@ void apply_definition(Definition definition,
       else if (state.alpha == Alpha::colorkey) {
         state.alpha_color = check_color();
       }  
+      else if (state.alpha == Alpha::premultiply) {
+        const auto rounding = (arguments_left() ? check_string() : "");
+        check(rounding.empty() || rounding == "exact", "invalid premultiply rounding");
+        state.premultiply_exact = (rounding == "exact");
+      }
       break;
     }
 
@@ -392,13 +407,23 @@ void apply_definition(Definition definition,
       const auto string = check_string();
       if (const auto index = index_of(string, 
           { "binpack", "rows", "columns", "compact", 
-            "origin", "single", "layers", "keep" }); index >= 0)
+            "origin", "single", "layers", "keep", "nest" }); index >= 0)
         state.pack = static_cast<Pack>(index);
       else
         error("invalid pack method '", string, "'");
       break;
     }
 
+    case Definition::pack_effort:
+      state.pack_effort = check_uint();
+      break;
+
+    case Definition::incremental:
+      state.incremental = true;
+      state.incremental_max_unused = (arguments_left() ? check_uint() : 50);
+      check(state.incremental_max_unused <= 100, "invalid percentage");
+      break;
+
     case Definition::scale:
       state.scale = check_real();
       check(state.scale >= 0.01 && state.scale < 100, "invalid scale");
@@ -418,6 +443,40 @@ void apply_definition(Definition definition,
       state.debug = check_bool(true);
       break;
 
+    case Definition::compression:
+      state.compression_level = check_uint();
+      check(state.compression_level <= 10, "invalid compression level");
+      if (arguments_left()) {
+        const auto string = check_string();
+        if (const auto index = index_of(string, 
+            { "adaptive", "none", "sub", "up", "average", "paeth" }); index >= 0)
+          state.compression_filter = static_cast<PngFilter>(index);
+        else
+          error("invalid compression filter '", string, "'");
+      }
+      break;
+
+    case Definition::encoding: {
+      const auto string = check_string();
+      if (const auto index = index_of(string, 
+          { "uncompressed", "bc1", "bc3", "bc7", "etc2", "etc2eac" }); index >= 0)
+        state.encoding = static_cast<TextureEncoding>(index);
+      else
+        error("invalid encoding '", string, "'");
+      break;
+    }
+
+    case Definition::mipmaps:
+      // 0 generates levels down to 1x1
+      state.mip_levels = (arguments_left() ? check_uint() : 0);
+      check(state.mip_levels <= 16, "invalid mip level count");
+      if (arguments_left()) {
+        state.mip_suffix = check_string_copy();
+        check(FilenameSequence(state.mip_suffix).is_sequence(), 
+          "mip suffix must be a sequence");
+      }
+      break;
+
     case Definition::path:
       state.path = check_path();
       break;
@@ -24,8 +24,13 @@ enum class Definition {
   duplicates,
   alpha,
   pack,
+  pack_effort,
+  incremental,
   scale,
   debug,
+  compression,
+  encoding,
+  mipmaps,
 
   path,
   glob,
@@ -86,10 +91,19 @@ struct State {
   Duplicates duplicates{ };
   Alpha alpha{ };
   RGBA alpha_color{ };
+  bool premultiply_exact{ };
   Pack pack{ };
+  int pack_effort{ -1 };
+  bool incremental{ };
+  int incremental_max_unused{ };
   real scale{ 1.0 };
   ResizeFilter scale_filter{ };
   bool debug{ };
+  int compression_level{ 8 };
+  PngFilter compression_filter{ };
+  TextureEncoding encoding{ };
+  int mip_levels{ 1 };
+  std::string mip_suffix{ "-mip{1-}" };
 
   std::filesystem::path path;
   std::string glob_pattern;
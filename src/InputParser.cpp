@@ -111,16 +111,8 @@ std::shared_ptr<Output> InputParser::get_output(
 ImagePtr InputParser::get_source(const std::filesystem::path& path,
     const std::filesystem::path& filename, RGBA colorkey) {
   auto& source = m_sources[std::filesystem::weakly_canonical(path / filename)];
-  if (!source) {
-    auto image = Image(path, filename);
-
-    if (colorkey != RGBA{ }) {
-      if (!colorkey.a)
-        colorkey = guess_colorkey(image);
-      replace_color(image, colorkey, RGBA{ });
-    }
-    source = std::make_shared<Image>(std::move(image));
-  }
+  if (!source)
+    source = std::make_shared<const Image>(path, filename, colorkey);
   return source;
 }
 
@@ -414,6 +406,9 @@ void InputParser::sheet_ends(State& state) {
   sheet.shape_padding = state.shape_padding;
   sheet.duplicates = state.duplicates;
   sheet.pack = state.pack;
+  sheet.pack_effort = state.pack_effort;
+  sheet.incremental = state.incremental;
+  sheet.incremental_max_unused = state.incremental_max_unused;
 }
 
 void InputParser::output_ends(State& state) {
@@ -425,9 +420,15 @@ void InputParser::output_ends(State& state) {
   output->map_suffixes = state.map_suffixes;
   output->alpha = state.alpha;
   output->alpha_color = state.alpha_color;
+  output->premultiply_exact = state.premultiply_exact;
   output->scale = state.scale;
   output->scale_filter = state.scale_filter;
   output->debug = state.debug;
+  output->compression_level = state.compression_level;
+  output->compression_filter = state.compression_filter;
+  output->encoding = state.encoding;
+  output->mip_levels = state.mip_levels;
+  output->mip_suffix = FilenameSequence(state.mip_suffix);
 }
 
 void InputParser::deduce_globbed_inputs(State& state) {
@@ -0,0 +1,26 @@
+
+#include "Scheduler.h"
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#elif defined(__linux__)
+# include <pthread.h>
+# include <sched.h>
+#endif
+
+void Scheduler::set_current_thread_affinity(uint64_t mask) {
+#if defined(_WIN32)
+  SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(mask));
+#elif defined(__linux__)
+  auto set = cpu_set_t{ };
+  CPU_ZERO(&set);
+  for (auto i = 0u; i < 64u; ++i)
+    if (mask & (uint64_t{ 1 } << i))
+      CPU_SET(i, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  // not supported
+  static_cast<void>(mask);
+#endif
+}
@@ -1,41 +1,54 @@
 #pragma once
 
 #include <thread>
+#include <algorithm>
+#include <iterator>
+#include <mutex>
 #include <condition_variable>
 #include <functional>
 #include <atomic>
+#include <memory>
 #include <vector>
-#include <list>
+#include <deque>
+#include <cstdint>
 
 class Scheduler {
 public:
   using AsyncFunction = std::function<void()>;
 
-  Scheduler() {
-    const auto count = std::max(std::thread::hardware_concurrency(), 2u) - 1;
-    m_threads.resize(count);
-    for (auto i = 0u; i < count; ++i)
-      m_threads[i] = std::thread(&Scheduler::thread_func, this);
-  }
-
+  Scheduler() = default;
   Scheduler(const Scheduler&) = delete;
   Scheduler& operator=(const Scheduler&) = delete;
 
   ~Scheduler() {
-    auto lock = std::unique_lock(m_tasks_mutex);
-    m_shutdown = true;
-    lock.unlock();
-    m_tasks_signal.notify_all();
-    for (auto& thread : m_threads)
-      thread.join();
+    stop();
+  }
+
+  // thread count includes the calling thread, 0 uses all hardware threads
+  // (or the number of CPUs in the affinity mask). Threads are started on
+  // first use. Must only be called while no tasks are running.
+  void configure(int thread_count, uint64_t affinity_mask = 0) {
+    stop();
+    m_thread_count = thread_count;
+    m_affinity_mask = affinity_mask;
+    if (m_affinity_mask)
+      set_current_thread_affinity(m_affinity_mask);
+  }
+
+  int thread_count() const {
+    if (m_thread_count > 0)
+      return m_thread_count;
+    if (m_affinity_mask)
+      return std::max(count_bits(m_affinity_mask), 1);
+    return static_cast<int>(std::max(std::thread::hardware_concurrency(), 2u));
   }
 
   void async(AsyncFunction function) noexcept {
-    auto lock = std::unique_lock(m_tasks_mutex);
-    m_tasks.push_back({ std::move(function), 1, 1 });
-    ++m_tasks_pending;
-    lock.unlock();
-    m_tasks_signal.notify_all();
+    start();
+    if (m_workers.empty())
+      return function();
+    push(new Task{ std::move(function) });
+    wake(1);
   }
 
   template<typename F> // F(size_t)
@@ -43,92 +56,355 @@ public:
     if (!count)
       return;
 
-    auto exception = std::exception_ptr();
-    auto next_index = std::atomic<size_t>{ };
-    auto local_remaining = std::atomic<size_t>{ count };
-    const auto parallel_function = [&]() noexcept {
-      try {
-        function(next_index.fetch_add(1));
-      }
-      catch (...) {
-        auto lock = std::lock_guard(m_tasks_mutex);
-        exception = std::current_exception();
-      }
-      local_remaining.fetch_sub(1);
-    };
+    start();
+    const auto threads = m_workers.size() + 1;
+    auto job = Job{ };
+    job.count = count;
+    job.chunk_size = std::max(count / (threads * 4), size_t{ 1 });
+    job.function = [&](size_t index) { function(index); };
 
-    auto lock = std::unique_lock(m_tasks_mutex);
-    m_tasks.push_back({ parallel_function, count, count });
-    m_tasks_pending += count;
-    m_tasks_signal.notify_all();
-    while (next_index < count)
-      execute_next(lock);
-    
-    m_done_signal.wait(lock, [&]() { return (local_remaining.load() == 0); });
-    if (exception)
-      std::rethrow_exception(exception);
+    const auto chunks = (count + job.chunk_size - 1) / job.chunk_size;
+    const auto helpers = std::min(chunks, threads) - 1;
+    job.helpers = helpers;
+    for (auto i = size_t{ }; i < helpers; ++i)
+      push(new Task{ [&job]() noexcept {
+        job.execute();
+        auto lock = std::lock_guard(job.mutex);
+        if (--job.helpers == 0)
+          job.done_signal.notify_all();
+      } });
+    wake(helpers);
+
+    job.execute();
+    wait(job);
+
+    if (job.exception)
+      std::rethrow_exception(job.exception);
   }
 
   template<typename It, typename F> // F(*It)
   void for_each_parallel(It begin, It end, F&& function) {
+    using Difference = typename std::iterator_traits<It>::difference_type;
     const auto count = static_cast<size_t>(std::distance(begin, end));
-    for_each_parallel(
-      [begin, function = std::forward<F>(function)](size_t index) {
-        function(*std::next(begin, static_cast<int>(index)));
-      }, count);
+    if (!count)
+      return;
+
+    // split range into chunks once, items are not searched from begin
+    const auto chunks = std::min(count, 
+      static_cast<size_t>(thread_count()) * 4);
+    auto bounds = std::vector<It>();
+    bounds.reserve(chunks + 1);
+    for (auto i = size_t{ }; i < chunks; ++i) {
+      bounds.push_back(begin);
+      std::advance(begin, static_cast<Difference>(
+        count * (i + 1) / chunks - count * i / chunks));
+    }
+    bounds.push_back(end);
+
+    for_each_parallel([&](size_t chunk) {
+      for (auto it = bounds[chunk]; it != bounds[chunk + 1]; ++it)
+        function(*it);
+    }, chunks);
   }
 
   template<typename R, typename F> // F(*It)
   void for_each_parallel(R&& range, F&& function) {
+    using std::begin;
+    using std::end;
     for_each_parallel(begin(range), end(range), std::move(function));
   }
 
 private:
-  void thread_func() {
-    auto lock = std::unique_lock(m_tasks_mutex);
-    for (;;) {
-      m_tasks_signal.wait(lock,
-        [&]() { return (m_shutdown || m_tasks_pending); });
-      if (m_shutdown)
-        break;
-      execute_next(lock);
+  struct Task {
+    AsyncFunction function;
+  };
+
+  // hands out chunks of indices to the caller and its helpers
+  struct Job {
+    std::function<void(size_t)> function;
+    size_t count{ };
+    size_t chunk_size{ };
+    std::atomic<size_t> next_index{ };
+    std::mutex mutex;
+    std::condition_variable done_signal;
+    size_t helpers{ };
+    std::exception_ptr exception;
+
+    void execute() noexcept {
+      for (;;) {
+        const auto begin = next_index.fetch_add(chunk_size);
+        if (begin >= count)
+          return;
+        const auto end = std::min(begin + chunk_size, count);
+        for (auto index = begin; index < end; ++index) {
+          try {
+            function(index);
+          }
+          catch (...) {
+            auto lock = std::lock_guard(mutex);
+            exception = std::current_exception();
+          }
+        }
+      }
+    }
+  };
+
+  // Chase-Lev deque, only the owner pushes and pops, others steal
+  class TaskDeque {
+  public:
+    TaskDeque() {
+      m_buffers.push_back(std::make_unique<Buffer>(64));
+      m_buffer.store(m_buffers.back().get(), std::memory_order_relaxed);
+    }
+
+    ~TaskDeque() {
+      while (auto task = pop())
+        delete task;
+    }
+
+    void push(Task* task) {
+      const auto bottom = m_bottom.load(std::memory_order_relaxed);
+      const auto top = m_top.load(std::memory_order_acquire);
+      auto buffer = m_buffer.load(std::memory_order_relaxed);
+      if (bottom - top > buffer->capacity - 1) {
+        m_buffers.push_back(buffer->grow(bottom, top));
+        buffer = m_buffers.back().get();
+        m_buffer.store(buffer, std::memory_order_release);
+      }
+      buffer->put(bottom, task);
+      std::atomic_thread_fence(std::memory_order_release);
+      m_bottom.store(bottom + 1, std::memory_order_relaxed);
     }
-  }
 
-  void execute_next(std::unique_lock<std::mutex>& lock) {
-    auto it = m_tasks.begin();
-    for (;; ++it) {
-      if (it == m_tasks.end())
-        return;
-      if (it->count > 0) {
-        --m_tasks_pending;
-        --it->count;
-        break;
+    Task* pop() {
+      const auto bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+      const auto buffer = m_buffer.load(std::memory_order_relaxed);
+      m_bottom.store(bottom, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      auto top = m_top.load(std::memory_order_relaxed);
+      if (top > bottom) {
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+      }
+      auto task = buffer->get(bottom);
+      if (top == bottom) {
+        // last task, race against thieves
+        if (!m_top.compare_exchange_strong(top, top + 1,
+              std::memory_order_seq_cst, std::memory_order_relaxed))
+          task = nullptr;
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
       }
+      return task;
+    }
+
+    Task* steal() {
+      auto top = m_top.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      const auto bottom = m_bottom.load(std::memory_order_acquire);
+      if (top >= bottom)
+        return nullptr;
+      const auto buffer = m_buffer.load(std::memory_order_acquire);
+      const auto task = buffer->get(top);
+      if (!m_top.compare_exchange_strong(top, top + 1,
+            std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+      return task;
     }
+
+  private:
+    struct Buffer {
+      const int64_t capacity;
+      std::unique_ptr<std::atomic<Task*>[]> tasks;
+
+      explicit Buffer(int64_t capacity)
+        : capacity(capacity),
+          tasks(new std::atomic<Task*>[static_cast<size_t>(capacity)]) {
+      }
+
+      std::atomic<Task*>& at(int64_t index) {
+        return tasks[static_cast<size_t>(index & (capacity - 1))];
+      }
+      Task* get(int64_t index) {
+        return at(index).load(std::memory_order_relaxed);
+      }
+      void put(int64_t index, Task* task) {
+        at(index).store(task, std::memory_order_relaxed);
+      }
+      std::unique_ptr<Buffer> grow(int64_t bottom, int64_t top) {
+        auto buffer = std::make_unique<Buffer>(capacity * 2);
+        for (auto i = top; i != bottom; ++i)
+          buffer->put(i, get(i));
+        return buffer;
+      }
+    };
+
+    std::atomic<int64_t> m_top{ };
+    std::atomic<int64_t> m_bottom{ };
+    std::atomic<Buffer*> m_buffer{ };
+    // thieves may still read from previous buffers
+    std::vector<std::unique_ptr<Buffer>> m_buffers;
+  };
+
+  struct Worker {
+    TaskDeque tasks;
+    std::thread thread;
+  };
+
+  void start() {
+    if (m_started.load(std::memory_order_acquire))
+      return;
+    auto lock = std::lock_guard(m_start_mutex);
+    if (m_started.load(std::memory_order_relaxed))
+      return;
+    const auto count = static_cast<size_t>(thread_count() - 1);
+    m_shutdown.store(false);
+    m_workers.resize(count);
+    for (auto& worker : m_workers)
+      worker = std::make_unique<Worker>();
+    for (auto i = size_t{ }; i < count; ++i)
+      m_workers[i]->thread = std::thread(&Scheduler::thread_func, this, i);
+    m_started.store(true, std::memory_order_release);
+  }
+
+  void stop() {
+    auto lock = std::unique_lock(m_sleep_mutex);
+    m_shutdown.store(true);
     lock.unlock();
+    m_wake_signal.notify_all();
+    for (auto& worker : m_workers)
+      worker->thread.join();
+    m_workers.clear();
+    m_started.store(false);
 
-    it->function();
+    // pending tasks are discarded
+    auto injected_lock = std::lock_guard(m_injected_mutex);
+    for (auto task : m_injected)
+      delete task;
+    m_injected.clear();
+    m_injected_count.store(0);
+  }
+
+  Worker* current_worker() const {
+    return (t_scheduler == this ? m_workers[t_worker_index].get() : nullptr);
+  }
 
-    lock.lock();
-    --it->remaining;
-    if (it->remaining == 0) {
-      m_tasks.erase(it);
-      m_done_signal.notify_all();
+  void push(Task* task) {
+    if (auto worker = current_worker()) {
+      worker->tasks.push(task);
     }
+    else {
+      auto lock = std::lock_guard(m_injected_mutex);
+      m_injected.push_back(task);
+      m_injected_count.fetch_add(1);
+    }
+    m_epoch.fetch_add(1);
   }
 
-  struct Task {
-    AsyncFunction function;
-    size_t count;
-    size_t remaining;
-  };
+  Task* find_task() {
+    const auto worker = current_worker();
+    if (worker)
+      if (auto task = worker->tasks.pop())
+        return task;
+
+    if (m_injected_count.load() > 0) {
+      auto lock = std::lock_guard(m_injected_mutex);
+      if (!m_injected.empty()) {
+        auto task = m_injected.front();
+        m_injected.pop_front();
+        m_injected_count.fetch_sub(1);
+        return task;
+      }
+    }
+
+    const auto count = m_workers.size();
+    const auto first = (worker ? t_worker_index + 1 : size_t{ });
+    for (auto i = size_t{ }; i < count; ++i) {
+      auto& victim = *m_workers[(first + i) % count];
+      if (&victim != worker)
+        if (auto task = victim.tasks.steal())
+          return task;
+    }
+    return nullptr;
+  }
+
+  static void execute(Task* task) {
+    task->function();
+    delete task;
+  }
+
+  void wake(size_t count) {
+    if (!count || m_sleeping.load() == 0)
+      return;
+    auto lock = std::lock_guard(m_sleep_mutex);
+    if (count > 1)
+      m_wake_signal.notify_all();
+    else
+      m_wake_signal.notify_one();
+  }
+
+  void wait(Job& job) {
+    for (;;) {
+      {
+        auto lock = std::lock_guard(job.mutex);
+        if (!job.helpers)
+          return;
+      }
+      // help out while waiting, which also executes own queued helpers
+      if (auto task = find_task()) {
+        execute(task);
+        continue;
+      }
+      // all remaining helpers are running on other threads
+      auto lock = std::unique_lock(job.mutex);
+      job.done_signal.wait(lock, [&]() { return !job.helpers; });
+      return;
+    }
+  }
+
+  static int count_bits(uint64_t mask) {
+    auto count = 0;
+    for (; mask; mask &= mask - 1)
+      ++count;
+    return count;
+  }
+
+  static void set_current_thread_affinity(uint64_t mask);
+
+  void thread_func(size_t index) {
+    t_scheduler = this;
+    t_worker_index = index;
+    if (m_affinity_mask)
+      set_current_thread_affinity(m_affinity_mask);
+    while (!m_shutdown.load()) {
+      const auto epoch = m_epoch.load();
+      if (auto task = find_task()) {
+        execute(task);
+        continue;
+      }
+      // sleep until a task was pushed since the search begun
+      m_sleeping.fetch_add(1);
+      auto lock = std::unique_lock(m_sleep_mutex);
+      m_wake_signal.wait(lock, [&]() {
+        return (m_shutdown.load() || m_epoch.load() != epoch);
+      });
+      m_sleeping.fetch_sub(1);
+    }
+  }
+
+  static inline thread_local const Scheduler* t_scheduler{ };
+  static inline thread_local size_t t_worker_index{ };
 
-  std::vector<std::thread> m_threads;
-  std::condition_variable m_tasks_signal;
-  std::condition_variable m_done_signal;
-  std::mutex m_tasks_mutex;
-  std::list<Task> m_tasks;
-  size_t m_tasks_pending{ };
-  bool m_shutdown{ };
+  int m_thread_count{ };
+  uint64_t m_affinity_mask{ };
+  std::mutex m_start_mutex;
+  std::atomic<bool> m_started{ };
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  std::mutex m_injected_mutex;
+  std::deque<Task*> m_injected;
+  std::atomic<size_t> m_injected_count{ };
+  std::mutex m_sleep_mutex;
+  std::condition_variable m_wake_signal;
+  std::atomic<size_t> m_epoch{ };
+  std::atomic<size_t> m_sleeping{ };
+  std::atomic<bool> m_shutdown{ };
 };
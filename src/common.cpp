@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <atomic>
 
 Scheduler scheduler;
 
@@ -13,6 +14,7 @@ namespace spright {
 namespace {
   const int max_warnings = 20;
   int g_warning_count = 0;
+  std::atomic<int> g_warnings_issued;
 
   class WarningDeduplicator {
   public:
@@ -61,6 +63,7 @@ namespace {
 } // namespace
 
 void warning(std::string_view message, int line_number) {
+  ++g_warnings_issued;
   if (g_warning_count < max_warnings)
     if (g_warning_deduplicator.add(message, line_number))
       ++g_warning_count;
@@ -71,6 +74,10 @@ bool has_warnings() {
   return std::exchange(g_warning_count, 0) > 0;
 }
 
+int get_warnings_issued() {
+  return g_warnings_issued;
+}
+
 std::filesystem::path utf8_to_path(std::string_view utf8_string) {
 #if defined(__cpp_char8_t)
   static_assert(sizeof(char) == sizeof(char8_t));
@@ -55,6 +55,8 @@ void check(bool condition, T&&... args) {
 
 void warning(std::string_view message, int line_number);
 bool has_warnings();
+// number of warnings issued, is not reset by has_warnings
+int get_warnings_issued();
 
 template<typename T> 
 int to_int(const T& v) { 
@@ -1,5 +1,7 @@
 
 #include "image.h"
+#include "png.h"
+#include "texture.h"
 #include "stb/stb_image.h"
 #include "stb/stb_image_write.h"
 #include "stb/stb_image_resize.h"
@@ -10,6 +12,14 @@
 #include <stdexcept>
 #include <cstring>
 #include <utility>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define SPRIGHT_SSE2
+# include <emmintrin.h>
+#endif
 
 #define TEXBLEED_IMPLEMENTATION
 #include "rmj/rmj_texbleed.h"
@@ -17,7 +27,6 @@
 namespace spright {
 
 namespace {
-  using RGBASpan = nonstd::span<RGBA>;
 
   inline void check(bool inside) {
     if (!inside)
@@ -184,34 +193,271 @@ namespace {
     }
   }
 
+  // calls read_memory(data, size) for embedded files, otherwise read_file(file)
+  template<typename M, typename F>
+  bool read_image_file(const std::filesystem::path& full_path,
+      M&& read_memory, F&& read_file) {
+#if defined(EMBED_TEST_FILES)
+    if (full_path == "test/Items.png") {
+      static const stbi_uc file[] {
+#include "test/Items.png.inc"
+      };
+      return read_memory(file, static_cast<int>(sizeof(file)));
+    }
+#else
+    static_cast<void>(read_memory);
+#endif
+
+#if defined(_WIN32)
+    auto file = _wfopen(full_path.wstring().c_str(), L"rb");
+#else
+    auto file = std::fopen(path_to_utf8(full_path).c_str(), "rb");
+#endif
+    if (!file)
+      return false;
+    const auto result = read_file(file);
+    std::fclose(file);
+    return result;
+  }
+
+  // rotating is done in tiles which fit in the L1 cache
+  const auto rotate_tile_size = 32;
+
+#if defined(SPRIGHT_SSE2)
+  // rotates a block of 4x4 pixels by reversing the rows and transposing
+  void rotate_block_4x4_cw(const RGBA* source, int source_stride,
+      RGBA* dest, int dest_stride) {
+    const auto load = [&](int y) {
+      return _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+        source + y * source_stride));
+    };
+    const auto r0 = load(3);
+    const auto r1 = load(2);
+    const auto r2 = load(1);
+    const auto r3 = load(0);
+    const auto t0 = _mm_unpacklo_epi32(r0, r1);
+    const auto t1 = _mm_unpacklo_epi32(r2, r3);
+    const auto t2 = _mm_unpackhi_epi32(r0, r1);
+    const auto t3 = _mm_unpackhi_epi32(r2, r3);
+    const auto store = [&](int y, __m128i value) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(
+        dest + y * dest_stride), value);
+    };
+    store(0, _mm_unpacklo_epi64(t0, t1));
+    store(1, _mm_unpackhi_epi64(t0, t1));
+    store(2, _mm_unpacklo_epi64(t2, t3));
+    store(3, _mm_unpackhi_epi64(t2, t3));
+  }
+#endif
+
+  // finds pixels with alpha or gray level not below threshold
+  class UsedPixelScanner {
+  public:
+    UsedPixelScanner(bool gray_levels, int threshold)
+      : m_gray_levels(gray_levels),
+        m_threshold(std::clamp(threshold, 0, 256)) {
+    }
+
+    // returns end when no pixel in [begin, end) is used
+    int find_first(const RGBA* row, int begin, int end) const {
+      auto x = begin;
+#if defined(SPRIGHT_SSE2)
+      const auto threshold = _mm_set1_epi32(m_threshold - 1);
+      for (; x + 4 <= end; x += 4)
+        if (const auto mask = used_mask(row + x, threshold))
+          return x + count_trailing_zeros(mask);
+#endif
+      for (; x < end; ++x)
+        if (is_used(row[x]))
+          return x;
+      return end;
+    }
+
+    // returns begin - 1 when no pixel in [begin, end) is used
+    int find_last(const RGBA* row, int begin, int end) const {
+      auto x = end;
+#if defined(SPRIGHT_SSE2)
+      const auto threshold = _mm_set1_epi32(m_threshold - 1);
+      for (; x - 4 >= begin; x -= 4)
+        if (const auto mask = used_mask(row + x - 4, threshold))
+          return x - 4 + (3 - count_leading_zeros4(mask));
+#endif
+      for (; x > begin; --x)
+        if (is_used(row[x - 1]))
+          return x - 1;
+      return begin - 1;
+    }
+
+  private:
+    bool is_used(const RGBA& rgba) const {
+      return ((m_gray_levels ? rgba.gray() : rgba.a) >= m_threshold);
+    }
+
+#if defined(SPRIGHT_SSE2)
+    // returns a bit for each of the 4 pixels, which is set when it is used
+    int used_mask(const RGBA* pixels, __m128i threshold) const {
+      const auto rgba = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels));
+      auto value = __m128i{ };
+      if (m_gray_levels) {
+        const auto byte = _mm_set1_epi32(0xFF);
+        const auto r = _mm_and_si128(rgba, byte);
+        const auto g = _mm_and_si128(_mm_srli_epi32(rgba, 8), byte);
+        const auto b = _mm_and_si128(_mm_srli_epi32(rgba, 16), byte);
+        // products and sum fit in the low 16 bits of each lane
+        value = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(
+          _mm_mullo_epi16(r, _mm_set1_epi32(77)),
+          _mm_mullo_epi16(g, _mm_set1_epi32(151))),
+          _mm_mullo_epi16(b, _mm_set1_epi32(28))), 8);
+      }
+      else {
+        value = _mm_srli_epi32(rgba, 24);
+      }
+      return _mm_movemask_ps(_mm_castsi128_ps(
+        _mm_cmpgt_epi32(value, threshold)));
+    }
+
+    static int count_trailing_zeros(int mask) {
+      auto count = 0;
+      for (; !(mask & 1); mask >>= 1)
+        ++count;
+      return count;
+    }
+
+    static int count_leading_zeros4(int mask) {
+      auto count = 0;
+      for (; !(mask & 0x8); mask <<= 1)
+        ++count;
+      return count;
+    }
+#endif
+
+    bool m_gray_levels;
+    int m_threshold;
+  };
+
+  // smallest x of a pixel, which has its center not left of position
+  int first_pixel_from(real position) {
+    auto x = static_cast<int>(std::ceil(position - 0.5));
+    while (x + 0.5 < position)
+      ++x;
+    while (x - 0.5 >= position)
+      --x;
+    return x;
+  }
+
+  // calls function(y, x0, x1) for each span of pixels within [0, w) x [0, h),
+  // which have their center inside the polygon (even-odd rule)
   // http://paulbourke.net/geometry/polygonmesh/
-  bool point_in_polygon(real x, real y, const std::vector<PointF>& p) {
-    auto c = false;
-    for (auto i = size_t{ }, j = p.size() - 1; i < p.size(); j = i++) {
-      if ((((p[i].y <= y) && (y < p[j].y)) ||
-           ((p[j].y <= y) && (y < p[i].y))) &&
-          (x < (p[j].x - p[i].x) * (y - p[i].y) / (p[j].y - p[i].y) + p[i].x))
-        c = !c;
+  template<typename F>
+  void for_each_polygon_span(const std::vector<PointF>& p, int w, int h, F&& function) {
+    if (p.empty())
+      return;
+    auto crossings = std::vector<real>();
+    for (auto y = 0; y < h; ++y) {
+      const auto yc = y + 0.5;
+      crossings.clear();
+      for (auto i = size_t{ }, j = p.size() - 1; i < p.size(); j = i++)
+        if (((p[i].y <= yc) && (yc < p[j].y)) ||
+            ((p[j].y <= yc) && (yc < p[i].y)))
+          crossings.push_back(
+            (p[j].x - p[i].x) * (yc - p[i].y) / (p[j].y - p[i].y) + p[i].x);
+      std::sort(crossings.begin(), crossings.end());
+
+      for (auto i = size_t{ 1 }; i < crossings.size(); i += 2) {
+        const auto x0 = std::max(first_pixel_from(crossings[i - 1]), 0);
+        const auto x1 = std::min(first_pixel_from(crossings[i]), w);
+        if (x0 < x1)
+          function(y, x0, x1);
+      }
     }
-    return c;
   }
 
+
+  // counts distinct colors, skipping fully transparent pixels. Switches to
+  // 5 bits per channel when there are too many distinct colors.
+  class ColorHistogram {
+  public:
+    struct Entry {
+      RGBA color;
+      uint32_t count;
+      std::array<uint64_t, 4> sum;
+    };
+
+    void add(const RGBA* begin, const RGBA* end) {
+      for (auto rgba = begin; rgba != end; ++rgba) {
+        if (rgba->a == 0)
+          continue;
+        const auto key = (rgba->rgba & m_key_mask);
+        auto [it, inserted] = m_indices.try_emplace(key, m_entries.size());
+        if (inserted) {
+          auto entry = Entry{ };
+          entry.color.rgba = key;
+          m_entries.push_back(entry);
+        }
+        auto& entry = m_entries[it->second];
+        ++entry.count;
+        for (auto i = 0; i < 4; ++i)
+          entry.sum[to_unsigned(i)] += rgba->channel(i);
+
+        if (m_entries.size() > max_exact_colors && m_key_mask == ~uint32_t{ })
+          reduce();
+      }
+    }
+
+    std::vector<Entry>& entries() { return m_entries; }
+
+  private:
+    static constexpr auto max_exact_colors = size_t{ 1 } << 16;
+
+    void reduce() {
+      m_key_mask = 0xF8F8F8F8u;
+      auto entries = std::move(m_entries);
+      m_entries.clear();
+      m_indices.clear();
+      for (const auto& entry : entries) {
+        const auto key = (entry.color.rgba & m_key_mask);
+        auto [it, inserted] = m_indices.try_emplace(key, m_entries.size());
+        if (inserted) {
+          m_entries.push_back(entry);
+          m_entries.back().color.rgba = key;
+          continue;
+        }
+        auto& reduced = m_entries[it->second];
+        reduced.count += entry.count;
+        for (auto i = 0u; i < 4; ++i)
+          reduced.sum[i] += entry.sum[i];
+      }
+    }
+
+    uint32_t m_key_mask{ ~uint32_t{ } };
+    std::vector<Entry> m_entries;
+    std::unordered_map<uint32_t, size_t> m_indices;
+  };
+
   // https://en.wikipedia.org/wiki/Median_cut
-  std::vector<RGBA> median_cut_reduction(RGBASpan image, int max_colors) {
+  Palette median_cut_reduction(ColorHistogram& histogram, int max_colors) {
+    using Entry = ColorHistogram::Entry;
+    using EntrySpan = nonstd::span<Entry>;
     struct Bucket {
       uint8_t max_channel_range;
-      RGBASpan colors;
+      EntrySpan entries;
     };
   
+    auto& entries = histogram.entries();
+    if (entries.empty())
+      return { RGBA{ } };
+
     auto buckets = std::vector<Bucket>();
-    const auto insert_bucket = [&](RGBASpan colors) {
+    const auto insert_bucket = [&](EntrySpan entries) {
       // compute channel with maximum range
       auto max_channel = 0;
       auto max_channel_range = uint8_t{ };
       for (auto i = 0; i < 4; ++i) {
-        const auto [min, max] = std::minmax_element(colors.begin(), colors.end(),
-          [&](const RGBA& a, const RGBA& b) { return a.channel(i) < b.channel(i); });
-        const auto channel_range = to_byte(max->channel(i) - min->channel(i));
+        const auto [min, max] = std::minmax_element(entries.begin(), entries.end(),
+          [&](const Entry& a, const Entry& b) { 
+            return a.color.channel(i) < b.color.channel(i); 
+          });
+        const auto channel_range = to_byte(max->color.channel(i) - min->color.channel(i));
         if (channel_range > max_channel_range) {
           max_channel_range = channel_range;
           max_channel = i;
@@ -219,70 +465,128 @@ namespace {
       }
 
       // sort colors by this channel
-      std::sort(colors.begin(), colors.end(), 
-        [&](const RGBA& a, const RGBA& b) { 
-          return a.channel(max_channel) < b.channel(max_channel); 
+      std::sort(entries.begin(), entries.end(), 
+        [&](const Entry& a, const Entry& b) { 
+          return a.color.channel(max_channel) < b.color.channel(max_channel); 
         });
 
       // insert sorted in bucket list
-      auto bucket = Bucket{ max_channel_range, colors };
+      auto bucket = Bucket{ max_channel_range, entries };
       buckets.insert(std::lower_bound(buckets.begin(), buckets.end(), bucket,
         [](const Bucket& a, const Bucket& b) {
           return (a.max_channel_range < b.max_channel_range);
         }), bucket);
     };
 
-    // start with one bucket containing whole image
-    insert_bucket(image);
+    // start with one bucket containing all colors
+    insert_bucket(entries);
 
     while (to_int(buckets.size()) < max_colors) {
       // split bucket with maximum range
-      auto [range, colors] = buckets.back();
+      auto [range, entries] = buckets.back();
       if (range == 0)
         break;
 
+      // at the median pixel, keeping both halves non-empty
+      auto total = uint64_t{ };
+      for (const auto& entry : entries)
+        total += entry.count;
+      auto median = size_t{ 1 };
+      for (auto count = uint64_t{ entries[0].count }; 
+           median < entries.size() - 1 && count < total / 2; ++median)
+        count += entries[median].count;
+
       buckets.pop_back();
-      insert_bucket(colors.subspan(0, colors.size() / 2));
-      insert_bucket(colors.subspan(colors.size() / 2));
+      insert_bucket(entries.subspan(0, median));
+      insert_bucket(entries.subspan(median));
     }
 
     // get average colors of buckets
     auto palette = Palette();
     for (const auto& bucket : buckets) {
-      auto sum = std::array<uint32_t, 4>();
-      for (const auto& color : bucket.colors)
-        for (auto i = 0; i < 4; ++i)
-          sum[to_unsigned(i)] += color.channel(i);
+      auto sum = std::array<uint64_t, 4>();
+      auto count = uint64_t{ };
+      for (const auto& entry : bucket.entries) {
+        for (auto i = 0u; i < 4; ++i)
+          sum[i] += entry.sum[i];
+        count += entry.count;
+      }
       auto color = RGBA{ };
       for (auto i = 0; i < 4; ++i)
-        color.channel(i) = to_byte(sum[to_unsigned(i)] / bucket.colors.size());
+        color.channel(i) = to_byte(sum[to_unsigned(i)] / count);
       palette.push_back(color);
     }
     return palette;
   }
 
-  int index_of_closest_palette_color(const Palette& palette, const RGBA& color) {
-    auto min_index = 0;
-    auto min_distance = std::numeric_limits<int>::max();
-    for (auto i = 0u; i < palette.size(); ++i) {
-      const auto r = palette[i].r - color.r;
-      const auto g = palette[i].g - color.g;
-      const auto b = palette[i].b - color.b;
-      const auto distance = (r * r + g * g + b * b);
-      if (distance < min_distance) {
-        min_index = to_int(i);
-        min_distance = distance;
+  // finds the closest palette color, the lowest index on equal distances
+  class PaletteLookup {
+  public:
+    explicit PaletteLookup(const Palette& palette) {
+      m_entries.reserve(palette.size());
+      for (auto i = 0u; i < palette.size(); ++i)
+        m_entries.push_back({ palette[i].r, palette[i].g, palette[i].b, to_int(i) });
+      std::sort(m_entries.begin(), m_entries.end(),
+        [](const Entry& a, const Entry& b) { return a.r < b.r; });
+      m_cache_keys.resize(cache_size, ~uint32_t{ });
+      m_cache_indices.resize(cache_size);
+    }
+
+    int find(const RGBA& color) {
+      const auto key = (color.rgba & 0x00FFFFFFu);
+      const auto slot = ((key * 2654435761u) >> (32 - cache_bits));
+      if (m_cache_keys[slot] != key) {
+        m_cache_keys[slot] = key;
+        m_cache_indices[slot] = search(color);
       }
+      return m_cache_indices[slot];
     }
-    return min_index;
-  }
 
-  const RGBA& closest_palette_color(const Palette& palette, const RGBA& color) {
-    return palette[to_unsigned(index_of_closest_palette_color(palette, color))];
-  }
+  private:
+    struct Entry {
+      int r, g, b;
+      int index;
+    };
+    static constexpr auto cache_bits = 12;
+    static constexpr auto cache_size = size_t{ 1 } << cache_bits;
+
+    // scans entries sorted by red outwards, until red alone is too distant
+    int search(const RGBA& color) const {
+      auto min_index = 0;
+      auto min_distance = std::numeric_limits<int>::max();
+      const auto check_entry = [&](const Entry& entry) {
+        const auto r = entry.r - color.r;
+        if (r * r > min_distance)
+          return false;
+        const auto g = entry.g - color.g;
+        const auto b = entry.b - color.b;
+        const auto distance = (r * r + g * g + b * b);
+        if (distance < min_distance ||
+            (distance == min_distance && entry.index < min_index)) {
+          min_index = entry.index;
+          min_distance = distance;
+        }
+        return true;
+      };
+      const auto middle = std::lower_bound(m_entries.begin(), m_entries.end(),
+        color.r, [](const Entry& entry, int r) { return entry.r < r; });
+      for (auto it = middle; it != m_entries.end(); ++it)
+        if (!check_entry(*it))
+          break;
+      for (auto it = middle; it != m_entries.begin(); )
+        if (!check_entry(*--it))
+          break;
+      return min_index;
+    }
+
+    std::vector<Entry> m_entries;
+    std::vector<uint32_t> m_cache_keys;
+    std::vector<int> m_cache_indices;
+  };
 
   // https://en.wikipedia.org/wiki/Floyd%E2%80%93Steinberg_dithering
-  Image floyd_steinberg_dithering(Image image, const Palette& palette) {
+  MonoImage floyd_steinberg_dithering(Image image, const Palette& palette,
+      PaletteLookup& lookup) {
     const auto diff = [](const uint8_t& a, const uint8_t& b) { 
       return static_cast<int>(a) - static_cast<int>(b);
     };
@@ -291,11 +595,14 @@ namespace {
     };
     const auto w = image.width();
     const auto h = image.height();
+    auto out = MonoImage(w, h);
     for (auto y = 0; y < h; ++y)
       for (auto x = 0; x < w; ++x) {
         auto& color = image.rgba_at({ x, y });
         const auto old_color = color;
-        color = closest_palette_color(palette, color);
+        const auto index = lookup.find(color);
+        out.value_at({ x, y }) = to_byte(index);
+        color = palette[to_unsigned(index)];
         const auto error_r = diff(old_color.r, color.r);
         const auto error_g = diff(old_color.g, color.g);
         const auto error_b = diff(old_color.b, color.b);
@@ -312,7 +619,36 @@ namespace {
         apply_error(x    , y + 1, 5);
         apply_error(x + 1, y + 1, 1);
       }
-    return image;
+    return out;
+  }
+
+  MonoImage quantize_image(const Image& image, const Palette& palette,
+      PaletteLookup lookup, bool dither) {
+    if (dither)
+      return floyd_steinberg_dithering(image.clone(), palette, lookup);
+
+    auto out = MonoImage(image.width(), image.height());
+    for (auto y = 0; y < image.height(); ++y)
+      for (auto x = 0; x < image.width(); ++x)
+        out.value_at({ x, y }) = to_byte(lookup.find(image.rgba_at({ x, y })));
+    return out;
+  }
+
+  // bounding rect of the pixels for which predicate(index) is true
+  template<typename F> // F(int)
+  Rect get_bounds(int width, int height, F&& predicate) {
+    auto min_x = width, max_x = -1, min_y = height, max_y = -1;
+    for (auto y = 0, i = 0; y < height; ++y)
+      for (auto x = 0; x < width; ++x, ++i)
+        if (predicate(i)) {
+          min_x = std::min(min_x, x);
+          max_x = std::max(max_x, x);
+          min_y = std::min(min_y, y);
+          max_y = y;
+        }
+    if (max_y < 0)
+      return { };
+    return { min_x, min_y, max_x - min_x + 1, max_y - min_y + 1 };
   }
 
   // https://giflib.sourceforge.net/whatsinagif/
@@ -334,10 +670,10 @@ namespace {
       *pos++ = color.b;
     }
 
+    auto lookup = PaletteLookup(palette);
     auto transparent_index = -1;
     if (animation.color_key)
-      transparent_index = index_of_closest_palette_color(
-        palette, *animation.color_key);
+      transparent_index = lookup.find(*animation.color_key);
 
     const auto [width, height] = first_image.bounds().size();
     if (width > 0xFFFF || height > 0xFFFF)
@@ -350,17 +686,157 @@ namespace {
     if (!gif)
       return false;
 
-    for (const auto& frame : animation.frames) {
+    // quantize frames in parallel
+    const auto& frames = animation.frames;
+    auto quantized = std::vector<MonoImage>(frames.size());
+    scheduler.for_each_parallel([&](size_t i) {
+      quantized[i] = quantize_image(frames[i].image, palette, lookup, true);
+    }, frames.size());
+
+    // only write the region which changed since the previous frame. With
+    // a transparent index, unchanged pixels are written transparent and a
+    // frame is restored to background, when its pixels become transparent
+    // in the next frame
+    const auto has_transparent = (transparent_index >= 0);
+    const auto transparent = static_cast<uint8_t>(transparent_index);
+    const auto pixel_count = to_unsigned(width * height);
+    auto canvas = std::vector<uint8_t>(pixel_count, transparent);
+    for (auto index = size_t{ }; index < frames.size(); ++index) {
+      const auto frame = quantized[index].data();
+      const auto next = (index + 1 < frames.size() ?
+        quantized[index + 1].data() : nullptr);
+      const auto vanishes = [&](size_t i) {
+        return (has_transparent && next && frame[i] != transparent &&
+                next[i] == transparent);
+      };
+
+      // decoders disagree about pixels not written by first frame
+      auto rect = Rect{ 0, 0, width, height };
+      if (index > 0)
+        rect = get_bounds(width, height, 
+          [&](int i) { return frame[i] != canvas[to_unsigned(i)]; });
+
+      auto disposal = 1;
+      const auto cleared = get_bounds(width, height,
+        [&](int i) { return vanishes(to_unsigned(i)); });
+      if (!empty(cleared)) {
+        rect = (empty(rect) ? cleared : combine(rect, cleared));
+        disposal = 2;
+      }
+      // write a single pixel to keep the delay
+      if (empty(rect))
+        rect = { 0, 0, 1, 1 };
+
+      for (auto y = rect.y; y < rect.y1(); ++y)
+        for (auto x = rect.x; x < rect.x1(); ++x) {
+          const auto i = to_unsigned(y * width + x);
+          gif->frame[i] = (has_transparent && frame[i] == canvas[i] &&
+            !vanishes(i) ? transparent : frame[i]);
+        }
+
       const auto delay = std::chrono::duration_cast<
         std::chrono::duration<uint16_t, std::ratio<1, 100>>>(
-        std::chrono::duration<real>(frame.duration)).count();
-      const auto mono = quantize_image(frame.image, palette, true);
-      std::memcpy(gif->frame, mono.data(), to_unsigned(width * height));
-      ge_add_frame(gif, delay);
+        std::chrono::duration<real>(frames[index].duration)).count();
+      ge_add_frame_rect(gif, delay, 
+        static_cast<uint16_t>(rect.x), static_cast<uint16_t>(rect.y),
+        static_cast<uint16_t>(rect.w), static_cast<uint16_t>(rect.h), disposal);
+
+      std::memcpy(canvas.data(), frame, canvas.size());
+      if (disposal == 2)
+        for (auto y = rect.y; y < rect.y1(); ++y)
+          std::fill_n(canvas.begin() + y * width + rect.x, rect.w, transparent);
+
+      // frame is no longer needed
+      quantized[index] = { };
     }
     ge_close_gif(gif);
     return true;
   }
+
+  // pixels per band when processing images in parallel
+  const auto pixel_band_size = 64 * 1024;
+
+  template<typename F> // F(RGBA* begin, RGBA* end)
+  void for_each_pixel_band(Image& image, F&& function) {
+    const auto size = static_cast<size_t>(image.width()) * 
+      static_cast<size_t>(image.height());
+    const auto bands = (size + pixel_band_size - 1) / pixel_band_size;
+    const auto rgba = image.rgba();
+    if (bands <= 1)
+      return function(rgba, rgba + size);
+    scheduler.for_each_parallel([&](size_t band) {
+      const auto begin = band * pixel_band_size;
+      const auto end = std::min(begin + pixel_band_size, size);
+      function(rgba + begin, rgba + end);
+    }, bands);
+  }
+
+  const auto alpha_mask = uint32_t{ 0xFF000000 };
+
+  // exactly (value + 127) / 255 for value <= 255 * 255
+  inline int divide_by_255(int value) {
+    value += 128;
+    return (value + (value >> 8)) >> 8;
+  }
+
+#if defined(SPRIGHT_SSE2)
+  inline __m128i load4(const RGBA* rgba) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba));
+  }
+
+  inline void store4(RGBA* rgba, __m128i value) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba), value);
+  }
+
+  inline __m128i select(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+  }
+
+  inline __m128i is_transparent4(__m128i rgba) {
+    return _mm_cmpeq_epi32(_mm_and_si128(rgba, 
+      _mm_set1_epi32(static_cast<int>(alpha_mask))), _mm_setzero_si128());
+  }
+
+  // multiplies the color channels of two pixels with their alpha
+  template<bool Exact>
+  __m128i premultiply2(__m128i rgba16) {
+    const auto alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(
+      rgba16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    auto product = _mm_mullo_epi16(rgba16, alpha);
+    if constexpr (Exact) {
+      product = _mm_add_epi16(product, _mm_set1_epi16(128));
+      product = _mm_add_epi16(product, _mm_srli_epi16(product, 8));
+    }
+    return _mm_srli_epi16(product, 8);
+  }
+
+  template<bool Exact>
+  __m128i premultiply4(__m128i rgba) {
+    const auto zero = _mm_setzero_si128();
+    const auto color = _mm_packus_epi16(
+      premultiply2<Exact>(_mm_unpacklo_epi8(rgba, zero)),
+      premultiply2<Exact>(_mm_unpackhi_epi8(rgba, zero)));
+    return select(_mm_set1_epi32(static_cast<int>(alpha_mask)), rgba, color);
+  }
+#endif
+
+  template<bool Exact>
+  void premultiply_alpha(RGBA* begin, RGBA* end) {
+    auto rgba = begin;
+#if defined(SPRIGHT_SSE2)
+    for (; rgba + 4 <= end; rgba += 4)
+      store4(rgba, premultiply4<Exact>(load4(rgba)));
+#endif
+    const auto multiply = [](int channel, int alpha) {
+      return to_byte(Exact ? divide_by_255(channel * alpha) : 
+                             channel * alpha / 256);
+    };
+    for (; rgba != end; ++rgba) {
+      rgba->r = multiply(rgba->r, rgba->a);
+      rgba->g = multiply(rgba->g, rgba->a);
+      rgba->b = multiply(rgba->b, rgba->a);
+    }
+  }
 } // namespace
 
 Image::Image(int width, int height)
@@ -381,42 +857,73 @@ Image::Image(int width, int height, const RGBA& background)
   std::fill(m_data, m_data + (m_width * m_height), background);
 }
 
-Image::Image(std::filesystem::path path, std::filesystem::path filename)
+struct Image::Decoder {
+  std::mutex mutex;
+  std::atomic<bool> decoded{ };
+};
+
+Image::Image(std::filesystem::path path, std::filesystem::path filename,
+    RGBA colorkey)
   : m_path(std::move(path)),
-    m_filename(std::move(filename)) {
+    m_filename(std::move(filename)),
+    m_colorkey(colorkey),
+    m_decoder(std::make_shared<Decoder>()) {
 
   const auto full_path = m_path / m_filename;
+  auto channels = 0;
+  if (!read_image_file(full_path,
+        [&](const stbi_uc* data, int size) {
+          return (stbi_info_from_memory(data, size,
+            &m_width, &m_height, &channels) != 0);
+        },
+        [&](FILE* file) {
+          return (stbi_info_from_file(file,
+            &m_width, &m_height, &channels) != 0);
+        }))
+    throw std::runtime_error("loading file '" + 
+      path_to_utf8(full_path) + "' failed");
+}
 
-#if defined(EMBED_TEST_FILES)
-  if (full_path == "test/Items.png") {
-    unsigned char file[] {
-#include "test/Items.png.inc"
-    };
-    auto channels = 0;
-    m_data = reinterpret_cast<RGBA*>(stbi_load_from_memory(
-        file, sizeof(file), &m_width, &m_height, &channels, sizeof(RGBA)));
+void Image::decode_pixels() const {
+  auto& decoder = *m_decoder;
+  if (decoder.decoded.load(std::memory_order_acquire))
     return;
-  }
-#endif
 
-#if defined(_WIN32)
-  if (auto file = _wfopen(full_path.wstring().c_str(), L"rb")) {
-#else
-  if (auto file = std::fopen(path_to_utf8(full_path).c_str(), "rb")) {
-#endif
-    auto channels = 0;
-    m_data = reinterpret_cast<RGBA*>(stbi_load_from_file(
-        file, &m_width, &m_height, &channels, sizeof(RGBA)));
-    std::fclose(file);
-  }
-  if (!m_data)
+  auto lock = std::lock_guard(decoder.mutex);
+  if (decoder.decoded.load(std::memory_order_relaxed))
+    return;
+
+  const auto full_path = m_path / m_filename;
+  auto image = Image();
+  auto channels = 0;
+  read_image_file(full_path,
+    [&](const stbi_uc* data, int size) {
+      image.m_data = reinterpret_cast<RGBA*>(stbi_load_from_memory(
+        data, size, &image.m_width, &image.m_height, &channels, sizeof(RGBA)));
+      return true;
+    },
+    [&](FILE* file) {
+      image.m_data = reinterpret_cast<RGBA*>(stbi_load_from_file(
+        file, &image.m_width, &image.m_height, &channels, sizeof(RGBA)));
+      return true;
+    });
+  if (!image.m_data || image.bounds() != bounds())
     throw std::runtime_error("loading file '" + 
       path_to_utf8(full_path) + "' failed");
+
+  if (m_colorkey != RGBA{ })
+    replace_color(image, (m_colorkey.a ? m_colorkey : 
+      guess_colorkey(image)), RGBA{ });
+
+  m_data = std::exchange(image.m_data, nullptr);
+  decoder.decoded.store(true, std::memory_order_release);
 }
 
 Image::Image(Image&& rhs)
   : m_path(std::exchange(rhs.m_path, { })),
     m_filename(std::exchange(rhs.m_filename, { })),
+    m_colorkey(std::exchange(rhs.m_colorkey, { })),
+    m_decoder(std::move(rhs.m_decoder)),
     m_data(std::exchange(rhs.m_data, nullptr)),
     m_width(std::exchange(rhs.m_width, 0)),
     m_height(std::exchange(rhs.m_height, 0)) {
@@ -426,6 +933,8 @@ Image& Image::operator=(Image&& rhs) {
   auto tmp = std::move(rhs);
   std::swap(m_path, tmp.m_path);
   std::swap(m_filename, tmp.m_filename);
+  std::swap(m_colorkey, tmp.m_colorkey);
+  std::swap(m_decoder, tmp.m_decoder);
   std::swap(m_data, tmp.m_data);
   std::swap(m_width, tmp.m_width);
   std::swap(m_height, tmp.m_height);
@@ -481,7 +990,8 @@ Image Image::clone(const Rect& rect) const {
   return clone;
 }
 
-void save_image(const Image& image, const std::filesystem::path& path) {
+void save_image(const Image& image, const std::filesystem::path& path,
+    int compression_level, PngFilter filter) {
   if (!path.parent_path().empty())
     std::filesystem::create_directories(path.parent_path());
   const auto filename = path_to_utf8(path);
@@ -490,24 +1000,43 @@ void save_image(const Image& image, const std::filesystem::path& path) {
   const auto h = image.height();
   const auto comp = sizeof(RGBA);
   const auto data = image.rgba();
-  const auto stride = image.width() * to_int(sizeof(RGBA));
 
   stbi_write_tga_with_rle = 1;
-  if (!(extension == ".png" && stbi_write_png(filename.c_str(), w, h, comp, data, stride)) &&
+  if (!(extension == ".png" && write_png(image, path, compression_level, filter)) &&
       !(extension == ".bmp" && stbi_write_bmp(filename.c_str(), w, h, comp, data)) &&
       !(extension == ".tga" && stbi_write_tga(filename.c_str(), w, h, comp, data)))
     error("writing file '", filename, "' failed");
 }
 
-void save_animation(const Animation& animation, const std::filesystem::path& path) {
+void save_animation(const Animation& animation, const std::filesystem::path& path,
+    int compression_level, PngFilter filter) {
   if (!path.parent_path().empty())
     std::filesystem::create_directories(path.parent_path());
   const auto filename = path_to_utf8(path);
   const auto extension = to_lower(path_to_utf8(path.extension()));
-  if (!(extension == ".gif" && write_gif(filename, animation)))
+  if (!(extension == ".gif" && write_gif(filename, animation)) &&
+      !(extension == ".png" && write_apng(animation, path, compression_level, filter)))
     error("writing file '", filename, "' failed");
 }
 
+void save_texture(const std::vector<Image>& levels, const std::filesystem::path& path,
+    TextureEncoding encoding, bool premultiplied) {
+  if (!path.parent_path().empty())
+    std::filesystem::create_directories(path.parent_path());
+  const auto filename = path_to_utf8(path);
+  const auto extension = to_lower(path_to_utf8(path.extension()));
+  if (extension == ".dds" && is_etc2(encoding))
+    error("ETC2 encoding is not supported by .dds file '", filename, "'");
+  if (!(extension == ".dds" && write_dds(levels, path, encoding, premultiplied)) &&
+      !(extension == ".ktx2" && write_ktx2(levels, path, encoding, premultiplied)))
+    error("writing file '", filename, "' failed");
+}
+
+bool is_texture_filename(const std::filesystem::path& path) {
+  const auto extension = to_lower(path_to_utf8(path.extension()));
+  return (extension == ".dds" || extension == ".ktx2");
+}
+
 void copy_rect(const Image& source, const Rect& source_rect, Image& dest, int dx, int dy) {
   const auto [sx, sy, w, h] = source_rect;
   const auto dest_rect = Rect{ dx, dy, w, h };
@@ -532,30 +1061,58 @@ void copy_rect_rotated_cw(const Image& source, const Rect& source_rect, Image& d
   const auto [sx, sy, w, h] = source_rect;
   check_rect(source, source_rect);
   check_rect(dest, { dx, dy, h, w });
-  for (auto y = 0; y < h; ++y)
-    for (auto x = 0; x < w; ++x)
-      std::memcpy(
-        dest.rgba() + ((dy + x) * dest.width() + (dx + h-1 - y)),
-        source.rgba() + ((sy + y) * source.width() + sx + x),
-        sizeof(RGBA));
+  const auto source_stride = source.width();
+  const auto dest_stride = dest.width();
+  const auto src = source.rgba() + (sy * source_stride + sx);
+  const auto dst = dest.rgba() + (dy * dest_stride + dx);
+
+  // source pixel (x, y) is written to dest pixel (h-1 - y, x)
+  for (auto ty = 0; ty < h; ty += rotate_tile_size)
+    for (auto tx = 0; tx < w; tx += rotate_tile_size) {
+      const auto y1 = std::min(ty + rotate_tile_size, h);
+      const auto x1 = std::min(tx + rotate_tile_size, w);
+      auto y = ty;
+#if defined(SPRIGHT_SSE2)
+      for (; y + 4 <= y1; y += 4) {
+        auto x = tx;
+        for (; x + 4 <= x1; x += 4)
+          rotate_block_4x4_cw(src + (y * source_stride + x), source_stride,
+            dst + (x * dest_stride + (h-1 - (y + 3))), dest_stride);
+        for (; x < x1; ++x)
+          for (auto i = y; i < y + 4; ++i)
+            dst[x * dest_stride + (h-1 - i)] = src[i * source_stride + x];
+      }
+#endif
+      for (; y < y1; ++y)
+        for (auto x = tx; x < x1; ++x)
+          dst[x * dest_stride + (h-1 - y)] = src[y * source_stride + x];
+    }
 }
 
 void copy_rect(const Image& source, const Rect& source_rect, Image& dest, int dx, int dy,
     const std::vector<PointF>& mask_vertices) {
   const auto [sx, sy, w, h] = source_rect;
-  for (auto y = 0; y < h; ++y)
-    for (auto x = 0; x < w; ++x)
-      if (point_in_polygon(x + 0.5, y + 0.5, mask_vertices))
-        checked_rgba_at(dest, { dx + x, dy + y }) = checked_rgba_at(source, { sx + x, sy + y });
+  check_rect(source, source_rect);
+  check_rect(dest, { dx, dy, w, h });
+  for_each_polygon_span(mask_vertices, w, h, [&](int y, int x0, int x1) {
+    std::memcpy(
+      dest.rgba() + ((dy + y) * dest.width() + dx + x0),
+      source.rgba() + ((sy + y) * source.width() + sx + x0),
+      to_unsigned(x1 - x0) * sizeof(RGBA));
+  });
 }
 
 void copy_rect_rotated_cw(const Image& source, const Rect& source_rect, Image& dest, int dx, int dy,
     const std::vector<PointF>& mask_vertices) {
   const auto [sx, sy, w, h] = source_rect;
-  for (auto y = 0; y < h; ++y)
-    for (auto x = 0; x < w; ++x)
-      if (point_in_polygon(x + 0.5, y + 0.5, mask_vertices))
-        checked_rgba_at(dest, { dx + (h-1 - y), dy + x }) = checked_rgba_at(source, { sx + x, sy + y });
+  check_rect(source, source_rect);
+  check_rect(dest, { dx, dy, h, w });
+  for_each_polygon_span(mask_vertices, w, h, [&](int y, int x0, int x1) {
+    const auto src = source.rgba() + ((sy + y) * source.width() + sx);
+    auto dst = dest.rgba() + (dx + h-1 - y);
+    for (auto x = x0; x < x1; ++x)
+      dst[(dy + x) * dest.width()] = src[x];
+  });
 }
 
 void extrude_rect(Image& image, const Rect& rect, int count, WrapMode mode,
@@ -694,35 +1251,59 @@ bool is_identical(const Image& image_a, const Rect& rect_a, const Image& image_b
   return true;
 }
 
+uint64_t hash_pixels(const Image& image, const Rect& rect) {
+  check_rect(image, rect);
+  // FNV-1a on whole pixels
+  auto hash = uint64_t{ 0xcbf29ce484222325 };
+  const auto rgba = image.rgba();
+  for (auto y = rect.y; y < rect.y + rect.h; ++y) {
+    const auto row = rgba + y * image.width();
+    for (auto x = rect.x; x < rect.x + rect.w; ++x)
+      hash = (hash ^ row[x].rgba) * uint64_t{ 0x100000001b3 };
+  }
+  return hash;
+}
+
 Rect get_used_bounds(const Image& image, bool gray_levels, int threshold, const Rect& rect) {
   if (empty(rect))
     return get_used_bounds(image, gray_levels, threshold, image.bounds());
 
-  const auto x1 = rect.x + rect.w - 1;
-  const auto y1 = rect.y + rect.h - 1;
-
-  const auto check = (gray_levels ? is_fully_black : is_fully_transparent);
-
+  check_rect(image, rect);
+  const auto x0 = rect.x;
+  const auto x1 = rect.x + rect.w;
+  const auto y1 = rect.y + rect.h;
+  const auto scanner = UsedPixelScanner(gray_levels, threshold);
+  const auto row = [&](int y) { return image.rgba() + y * image.width(); };
+
+  auto min_x = x1;
+  auto max_x = x0 - 1;
   auto min_y = rect.y;
-  for (; min_y < y1; ++min_y)
-    if (!check(image, threshold, { rect.x, min_y, rect.w, 1 }))
-      break;
-
-  auto max_y = y1;
-  for (; max_y > min_y; --max_y)
-    if (!check(image, threshold, { rect.x, max_y, rect.w, 1 }))
-      break;
-
-  auto min_x = rect.x;
-  for (; min_x < x1; ++min_x)
-    if (!check(image, threshold, { min_x, min_y, 1, max_y - min_y + 1 }))
+  for (; min_y < y1; ++min_y) {
+    min_x = scanner.find_first(row(min_y), x0, x1);
+    if (min_x < x1) {
+      max_x = scanner.find_last(row(min_y), min_x, x1);
       break;
-
-  auto max_x = x1;
-  for (; max_x > min_x; --max_x)
-    if (!check(image, threshold, { max_x, min_y, 1, max_y - min_y + 1 }))
+    }
+  }
+  // when nothing is used, the last pixel is returned
+  if (min_y == y1)
+    return { x1 - 1, y1 - 1, 1, 1 };
+
+  auto max_y = y1 - 1;
+  for (; max_y > min_y; --max_y) {
+    const auto first = scanner.find_first(row(max_y), x0, x1);
+    if (first < x1) {
+      min_x = std::min(min_x, first);
+      max_x = std::max(max_x, scanner.find_last(row(max_y), first, x1));
       break;
+    }
+  }
 
+  // only the columns outside the current bounds need to be scanned
+  for (auto y = min_y + 1; y < max_y; ++y) {
+    min_x = scanner.find_first(row(y), x0, min_x);
+    max_x = scanner.find_last(row(y), max_x + 1, x1);
+  }
   return { min_x, min_y, max_x - min_x + 1, max_y - min_y + 1 };
 }
 
@@ -797,41 +1378,62 @@ std::vector<Rect> find_islands(const Image& image, int merge_distance,
 }
 
 void clear_alpha(Image& image, RGBA color) {
-  std::for_each(image.rgba(), image.rgba() + image.width() * image.height(),
-    [&](RGBA& rgba) {
-      if (rgba.a == 0)
-        rgba = color;
-    });
+  for_each_pixel_band(image, [&](RGBA* begin, RGBA* end) {
+    auto rgba = begin;
+#if defined(SPRIGHT_SSE2)
+    const auto color4 = _mm_set1_epi32(static_cast<int>(color.rgba));
+    for (; rgba + 4 <= end; rgba += 4) {
+      const auto value = load4(rgba);
+      store4(rgba, select(is_transparent4(value), color4, value));
+    }
+#endif
+    for (; rgba != end; ++rgba)
+      if (rgba->a == 0)
+        *rgba = color;
+  });
 }
 
 void make_opaque(Image& image) {
-  std::for_each(image.rgba(), image.rgba() + image.width() * image.height(),
-    [&](RGBA& rgba) {
-      rgba.a = 255;
-    });
+  for_each_pixel_band(image, [&](RGBA* begin, RGBA* end) {
+    auto rgba = begin;
+#if defined(SPRIGHT_SSE2)
+    const auto alpha4 = _mm_set1_epi32(static_cast<int>(alpha_mask));
+    for (; rgba + 4 <= end; rgba += 4)
+      store4(rgba, _mm_or_si128(load4(rgba), alpha4));
+#endif
+    for (; rgba != end; ++rgba)
+      rgba->a = 255;
+  });
 }
 
 void make_opaque(Image& image, RGBA background) {
-  std::for_each(image.rgba(), image.rgba() + image.width() * image.height(),
-    [&](RGBA& rgba) {
-      if (rgba.a == 0)
-        rgba = background;
+  for_each_pixel_band(image, [&](RGBA* begin, RGBA* end) {
+    auto rgba = begin;
+#if defined(SPRIGHT_SSE2)
+    const auto background4 = _mm_set1_epi32(static_cast<int>(background.rgba));
+    const auto alpha4 = _mm_set1_epi32(static_cast<int>(alpha_mask));
+    for (; rgba + 4 <= end; rgba += 4) {
+      const auto value = load4(rgba);
+      store4(rgba, select(is_transparent4(value), background4, 
+        _mm_or_si128(value, alpha4)));
+    }
+#endif
+    for (; rgba != end; ++rgba) {
+      if (rgba->a == 0)
+        *rgba = background;
       else
-        rgba.a = 255;
-    });
+        rgba->a = 255;
+    }
+  });
 }
 
-void premultiply_alpha(Image& image) {
-  const auto multiply = [](int channel, int alpha) {
-    return to_byte(channel * alpha / 256);
-  };
-  const auto size = image.width() * image.height();
-  auto rgba = image.rgba();
-  for (auto i = 0; i < size; ++i, ++rgba) {
-    rgba->r = multiply(rgba->r, rgba->a);
-    rgba->g = multiply(rgba->g, rgba->a);
-    rgba->b = multiply(rgba->b, rgba->a);
-  }
+void premultiply_alpha(Image& image, bool exact) {
+  for_each_pixel_band(image, [&](RGBA* begin, RGBA* end) {
+    if (exact)
+      premultiply_alpha<true>(begin, end);
+    else
+      premultiply_alpha<false>(begin, end);
+  });
 }
 
 void bleed_alpha(Image& image) {
@@ -865,58 +1467,94 @@ MonoImage get_gray_levels(const Image& image, const Rect& rect) {
 Image resize_image(const Image& image, real scale, ResizeFilter filter) {
   const auto width = to_int(image.width() * scale + 0.5);
   const auto height = to_int(image.height() * scale + 0.5);
-  if (width == image.width() && height == image.height())
-    return image.clone();
-
   if (filter == ResizeFilter::undefined &&
       std::fmod(scale, 1.0f) == 0)
     filter = ResizeFilter::box;
+  return resize_image(image, { width, height }, filter);
+}
+
+Image resize_image(const Image& image, const Size& size, ResizeFilter filter,
+    bool premultiplied) {
+  const auto [width, height] = size;
+  if (width == image.width() && height == image.height())
+    return image.clone();
 
   auto output = Image(width, height);
-  const auto flags = 0;
+  resize_image_rows(image, 0, image.height(), output, 0, height, 
+    filter, premultiplied);
+  return output;
+}
+
+void resize_image_rows(const Image& input, int input_y, int input_height,
+    Image& output, int output_y, int output_height, ResizeFilter filter,
+    bool premultiplied) {
+  const auto flags = (premultiplied ? STBIR_FLAG_ALPHA_PREMULTIPLIED : 0);
   const auto edge_mode = STBIR_EDGE_CLAMP;
   const auto color_space = STBIR_COLORSPACE_SRGB;
   const auto bytes_per_pixel = int{ sizeof(RGBA) };
-  if (!stbir_resize(image.rgba(), image.width(), image.height(), image.width() * bytes_per_pixel,
-        output.rgba(), width, height, width * bytes_per_pixel,
-        STBIR_TYPE_UINT8, 4, 3, flags, edge_mode, edge_mode, 
-        static_cast<stbir_filter>(filter), static_cast<stbir_filter>(filter), 
-        color_space, nullptr))
+  const auto width = output.width();
+  const auto height = output.height();
+  const auto x_scale = static_cast<float>(width) / static_cast<float>(input.width());
+  const auto y_scale = static_cast<float>(output_height) / static_cast<float>(input_height);
+  // the input rows are addressed as part of the whole input image, so the
+  // filter coefficients do not depend on the rows passed. stb_image_resize
+  // only reads the rows within the filter support of the output rows and
+  // subtracts input_y from their index
+
+  // bands of output rows are resized in parallel
+  const auto band_height = 64;
+  const auto bands = (height + band_height - 1) / band_height;
+  auto failed = std::atomic<bool>{ };
+  scheduler.for_each_parallel([&](size_t band) {
+    const auto y = to_int(band) * band_height;
+    if (!stbir_resize_subpixel_rows(input.rgba(), input.width(), input_height, 
+          input.width() * bytes_per_pixel,
+          &output.rgba_at({ 0, y }), width, std::min(band_height, height - y), 
+          width * bytes_per_pixel,
+          STBIR_TYPE_UINT8, 4, 3, flags, edge_mode, edge_mode, 
+          static_cast<stbir_filter>(filter), static_cast<stbir_filter>(filter), 
+          color_space, nullptr, x_scale, y_scale, 0, 
+          static_cast<float>(output_y + y), input_y))
+      failed = true;
+  }, static_cast<size_t>(bands));
+  if (failed)
     throw std::bad_alloc();
-  return output;
 }
 
-Palette generate_palette(const Image& image_, int count) {
-  auto image = image_.clone();
-  const auto size = static_cast<size_t>(image.width() * image.height());
-  return median_cut_reduction({ image.rgba(), size }, count);
+std::vector<Image> generate_mip_levels(Image image, int count, 
+    ResizeFilter filter, bool premultiplied) {
+  if (filter == ResizeFilter::undefined)
+    filter = ResizeFilter::box;
+  auto levels = std::vector<Image>();
+  for (;;) {
+    const auto size = Size{ std::max(image.width() / 2, 1), 
+                            std::max(image.height() / 2, 1) };
+    const auto last = (to_int(levels.size()) + 1 == count ||
+      (image.width() == 1 && image.height() == 1));
+    levels.push_back(std::move(image));
+    if (last)
+      return levels;
+    image = resize_image(levels.back(), size, filter, premultiplied);
+  }
+}
+
+Palette generate_palette(const Image& image, int count) {
+  auto histogram = ColorHistogram();
+  histogram.add(image.rgba(), image.rgba() + image.width() * image.height());
+  return median_cut_reduction(histogram, count);
 }
 
 Palette generate_palette(const Animation& animation, int count) {
-  auto merged_size = size_t{ };
-  for (const auto& frame : animation.frames)
-    merged_size += static_cast<size_t>(frame.image.width() * frame.image.height());
-  auto merged = std::make_unique<RGBA[]>(merged_size);
-  auto pos = merged.get();
+  auto histogram = ColorHistogram();
   for (const auto& frame : animation.frames) {
-    const auto size = static_cast<size_t>(frame.image.width() * frame.image.height());
-    std::memcpy(pos, frame.image.rgba(), size * sizeof(RGBA));
-    pos += size;
+    const auto& image = frame.image;
+    histogram.add(image.rgba(), image.rgba() + image.width() * image.height());
   }
-  return median_cut_reduction({ merged.get(), merged_size }, count);
+  return median_cut_reduction(histogram, count);
 }
 
 MonoImage quantize_image(const Image& image, const Palette& palette, bool dither) {
-  if (dither)
-    return quantize_image(floyd_steinberg_dithering(
-      image.clone(), palette), palette, false);
-
-  auto out = MonoImage(image.width(), image.height());
-  for (auto y = 0; y < image.height(); ++y)
-    for (auto x = 0; x < image.width(); ++x)
-      out.value_at({ x, y }) = to_byte(
-        index_of_closest_palette_color(palette, image.rgba_at({ x, y })));
-  return out;
+  return quantize_image(image, palette, PaletteLookup(palette), dither);
 }
 
 Image apply_palette(const MonoImage& image, const Palette& palette) {
@@ -2,6 +2,7 @@
 
 #include "common.h"
 #include <filesystem>
+#include <memory>
 
 namespace spright {
 
@@ -10,27 +11,40 @@ public:
   Image() = default;
   Image(int width, int height);
   Image(int width, int height, const RGBA& background);
-  Image(std::filesystem::path path, std::filesystem::path filename);
+  // only reads the file's header, the pixels are decoded on first access.
+  // pixels with the colorkey become transparent (it is guessed when alpha is 0)
+  Image(std::filesystem::path path, std::filesystem::path filename,
+    RGBA colorkey = { });
   Image(Image&& rhs);
   Image& operator=(Image&& rhs);
   ~Image();
   Image clone(const Rect& rect = {}) const;
-  explicit operator bool() const { return m_data != nullptr; }
+  explicit operator bool() const { return m_width > 0; }
+
+  // can be called from any thread, blocks while another one is decoding
+  void decode() const { if (m_decoder) decode_pixels(); }
 
   const std::filesystem::path& path() const { return m_path; }
   const std::filesystem::path& filename() const { return m_filename; }
+  const RGBA& colorkey() const { return m_colorkey; }
   int width() const { return m_width; }
   int height() const { return m_height; }
   Rect bounds() const { return { 0, 0, m_width, m_height }; }
-  const RGBA* rgba() const { return m_data; }
-  RGBA* rgba() { return m_data; }
+  const RGBA* rgba() const { decode(); return m_data; }
+  RGBA* rgba() { decode(); return m_data; }
+  // pixels need to be decoded (e.g. by calling rgba())
   RGBA& rgba_at(const Point& p) { return m_data[p.y * m_width + p.x]; }
   const RGBA& rgba_at(const Point& p) const { return m_data[p.y * m_width + p.x]; }
 
 private:
+  struct Decoder;
+  void decode_pixels() const;
+
   std::filesystem::path m_path;
   std::filesystem::path m_filename;
-  RGBA* m_data{ };
+  RGBA m_colorkey{ };
+  std::shared_ptr<Decoder> m_decoder;
+  mutable RGBA* m_data{ };
   int m_width{ };
   int m_height{ };
 };
@@ -74,6 +88,29 @@ enum class ResizeFilter {
   mitchell      // Mitchell-Netrevalli filter with B=1/3, C=1/3
 };
 
+enum class PngFilter {
+  adaptive, // Chooses the filter with minimum sum of absolute differences per row
+  none,
+  sub,
+  up,
+  average,
+  paeth
+};
+
+enum class TextureEncoding {
+  uncompressed,
+  bc1, // RGB with 1 bit alpha, 4 bits per pixel
+  bc3, // RGBA, 8 bits per pixel
+  bc7, // RGBA, 8 bits per pixel, higher quality
+  etc2, // RGB, 4 bits per pixel
+  etc2_eac // RGBA, 8 bits per pixel
+};
+
+inline bool is_etc2(TextureEncoding encoding) {
+  return (encoding == TextureEncoding::etc2 ||
+          encoding == TextureEncoding::etc2_eac);
+}
+
 struct Animation {
   struct Frame {
     int index;
@@ -88,9 +125,25 @@ struct Animation {
 
 using Palette = std::vector<RGBA>;
 
-void save_image(const Image& image, const std::filesystem::path& filename);
-void save_animation(const Animation& animation, const std::filesystem::path& filename);
+void save_image(const Image& image, const std::filesystem::path& filename,
+  int compression_level = 8, PngFilter filter = PngFilter::adaptive);
+void save_animation(const Animation& animation, const std::filesystem::path& filename,
+  int compression_level = 8, PngFilter filter = PngFilter::adaptive);
+void save_texture(const std::vector<Image>& levels, const std::filesystem::path& filename,
+  TextureEncoding encoding, bool premultiplied = false);
+bool is_texture_filename(const std::filesystem::path& filename);
 Image resize_image(const Image& image, real scale, ResizeFilter filter);
+Image resize_image(const Image& image, const Size& size, ResizeFilter filter,
+  bool premultiplied = false);
+// resizes the output rows [output_y, output_y + output.height()) of an image
+// of output_height rows, from its input rows [input_y, input_y + input.height()),
+// which need to include the filter support
+void resize_image_rows(const Image& input, int input_y, int input_height,
+  Image& output, int output_y, int output_height, ResizeFilter filter,
+  bool premultiplied = false);
+// count includes the image itself, 0 generates levels down to 1x1
+std::vector<Image> generate_mip_levels(Image image, int count, 
+  ResizeFilter filter, bool premultiplied);
 void copy_rect(const Image& source, const Rect& source_rect, Image& dest, int dx, int dy);
 void copy_rect_rotated_cw(const Image& source, const Rect& source_rect, Image& dest, int dx, int dy);
 void copy_rect(const Image& source, const Rect& source_rect, Image& dest, 
@@ -110,6 +163,7 @@ bool is_opaque(const Image& image, const Rect& rect = { });
 bool is_fully_transparent(const Image& image, int threshold = 1, const Rect& rect = { });
 bool is_fully_black(const Image& image, int threshold = 1, const Rect& rect = { });
 bool is_identical(const Image& image_a, const Rect& rect_a, const Image& image_b, const Rect& rect_b);
+uint64_t hash_pixels(const Image& image, const Rect& rect);
 Rect get_used_bounds(const Image& image, bool gray_levels, int threshold = 1, const Rect& rect = { });
 RGBA guess_colorkey(const Image& image);
 void replace_color(Image& image, RGBA original, RGBA color);
@@ -118,7 +172,7 @@ std::vector<Rect> find_islands(const Image& image, int merge_distance,
 void clear_alpha(Image& image, RGBA color);
 void make_opaque(Image& image);
 void make_opaque(Image& image, RGBA background);
-void premultiply_alpha(Image& image);
+void premultiply_alpha(Image& image, bool exact = false);
 void bleed_alpha(Image& image);
 MonoImage get_alpha_levels(const Image& image, const Rect& rect = { });
 MonoImage get_gray_levels(const Image& image, const Rect& rect = { });
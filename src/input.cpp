@@ -5,6 +5,7 @@
 #include <sstream>
 #include <iostream>
 #include <variant>
+#include <set>
 
 namespace spright {
 
@@ -43,4 +44,33 @@ int get_max_slice_count(const Sheet& sheet) {
   return max_count;
 }
 
+std::string get_source_stamp(const Image& source) {
+  const auto filename = source.path() / source.filename();
+  auto error = std::error_code{ };
+  const auto size = std::filesystem::file_size(filename, error);
+  if (error)
+    return { };
+  const auto time = std::filesystem::last_write_time(filename, error);
+  if (error)
+    return { };
+  auto ss = std::ostringstream();
+  ss << path_to_utf8(filename) << "|" << size << "|" <<
+    time.time_since_epoch().count() << "|" << source.colorkey().rgba;
+  return ss.str();
+}
+
+void prefetch_pixels(const std::vector<ImagePtr>& sources) {
+  auto prefetched = std::set<const Image*>();
+  for (const auto& source : sources)
+    if (source && prefetched.insert(source.get()).second)
+      scheduler.async([source]() {
+        try {
+          source->decode();
+        }
+        catch (...) {
+          // rethrown on access
+        }
+      });
+}
+
 } // namespace
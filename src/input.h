@@ -32,7 +32,7 @@ enum class Trim { none, rect, convex };
 
 enum class Alpha { keep, opaque, clear, bleed, premultiply, colorkey };
 
-enum class Pack { binpack, rows, columns, compact, origin, single, layers, keep };
+enum class Pack { binpack, rows, columns, compact, origin, single, layers, keep, nest };
 
 enum class Duplicates { keep, share, drop };
 
@@ -54,9 +54,15 @@ struct Output {
   std::vector<std::string> map_suffixes;
   Alpha alpha{ };
   RGBA alpha_color{ };
+  bool premultiply_exact{ };
   real scale{ };
   ResizeFilter scale_filter{ };
   bool debug{ };
+  int compression_level{ };
+  PngFilter compression_filter{ };
+  TextureEncoding encoding{ };
+  int mip_levels{ };
+  FilenameSequence mip_suffix;
 };
 
 struct Sheet {
@@ -76,6 +82,12 @@ struct Sheet {
   int shape_padding{ };
   Duplicates duplicates{ };
   Pack pack{ };
+  // number of binpack heuristics searched in addition to the fastest,
+  // negative selects one by the number of sprites
+  int pack_effort{ -1 };
+  // keep sprites of the previous layout, unless more area is unused
+  bool incremental{ };
+  int incremental_max_unused{ };
 };
 
 struct Sprite {
@@ -134,5 +146,9 @@ struct InputDefinition {
 
 InputDefinition parse_definition(const Settings& settings);
 int get_max_slice_count(const Sheet& sheet);
+// identifies the source file's version without decoding it
+std::string get_source_stamp(const Image& source);
+// starts decoding the sources in background, accessing the pixels waits
+void prefetch_pixels(const std::vector<ImagePtr>& sources);
 
 } // namespace
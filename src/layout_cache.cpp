@@ -0,0 +1,381 @@
+
+#include "layout_cache.h"
+#include <cstring>
+#include <set>
+
+namespace spright {
+
+namespace {
+  const auto layout_cache_magic = uint32_t{ 0x4C525053 }; // "SPRL"
+  const auto layout_cache_version = uint32_t{ 4 };
+
+  class Writer {
+  public:
+    template<typename T>
+    void write(const T& value) {
+      static_assert(std::is_trivially_copyable_v<T>);
+      m_data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void write(std::string_view string) {
+      write(static_cast<uint32_t>(string.size()));
+      m_data.append(string);
+    }
+
+    const std::string& data() const { return m_data; }
+
+  private:
+    std::string m_data;
+  };
+
+  class Reader {
+  public:
+    explicit Reader(std::string_view data) : m_data(data) { }
+
+    template<typename T>
+    T read() {
+      static_assert(std::is_trivially_copyable_v<T>);
+      auto value = T{ };
+      if (m_data.size() < sizeof(T)) {
+        m_failed = true;
+        return value;
+      }
+      std::memcpy(&value, m_data.data(), sizeof(T));
+      m_data.remove_prefix(sizeof(T));
+      return value;
+    }
+
+    bool failed() const { return m_failed; }
+    bool at_end() const { return m_data.empty(); }
+
+  private:
+    std::string_view m_data;
+    bool m_failed{ };
+  };
+
+  uint64_t hash_fnv1a(std::string_view data) {
+    auto hash = uint64_t{ 14695981039346656037ull };
+    for (auto c : data) {
+      hash ^= static_cast<uint8_t>(c);
+      hash *= uint64_t{ 1099511628211ull };
+    }
+    return hash;
+  }
+
+  void write_sheet(Writer& writer, const Sheet& sheet) {
+    writer.write(sheet.index);
+    writer.write(sheet.width);
+    writer.write(sheet.height);
+    writer.write(sheet.max_width);
+    writer.write(sheet.max_height);
+    writer.write(sheet.power_of_two);
+    writer.write(sheet.square);
+    writer.write(sheet.divisible_width);
+    writer.write(sheet.allow_rotate);
+    writer.write(sheet.border_padding);
+    writer.write(sheet.shape_padding);
+    writer.write(sheet.duplicates);
+    writer.write(sheet.pack);
+    writer.write(sheet.pack_effort);
+    writer.write(sheet.incremental);
+    writer.write(sheet.incremental_max_unused);
+    writer.write(get_max_slice_count(sheet));
+  }
+
+  void write_sprite(Writer& writer, const Sprite& sprite) {
+    writer.write(sprite.index);
+    writer.write(sprite.sheet ? sprite.sheet->index : -1);
+    writer.write(sprite.source_rect);
+    writer.write(sprite.pivot);
+    writer.write(sprite.trim);
+    writer.write(sprite.trim_margin);
+    writer.write(sprite.trim_threshold);
+    writer.write(sprite.trim_gray_levels);
+    writer.write(sprite.crop);
+    writer.write(sprite.crop_pivot);
+    writer.write(sprite.extrude);
+    writer.write(sprite.min_bounds);
+    writer.write(sprite.divisible_bounds);
+    writer.write(std::string_view(sprite.common_bounds));
+    writer.write(sprite.align);
+    writer.write(std::string_view(sprite.align_pivot));
+  }
+
+  // identifies a sprite across changes of the definition
+  uint64_t get_sprite_key(const Sprite& sprite) {
+    if (!sprite.sheet || !sprite.source)
+      return 0;
+    auto writer = Writer();
+    write_sheet(writer, *sprite.sheet);
+    writer.write(std::string_view(path_to_utf8(
+      sprite.source->path() / sprite.source->filename())));
+    writer.write(sprite.source_rect);
+    return std::max(hash_fnv1a(writer.data()), uint64_t{ 1 });
+  }
+
+  // the data is followed by its hash, to detect truncated or corrupt files
+  std::optional<std::string> read_layout_file(
+      const std::filesystem::path& filename) try {
+    auto error = std::error_code{ };
+    if (!std::filesystem::exists(filename, error))
+      return std::nullopt;
+    auto data = read_textfile(filename);
+    if (data.size() < sizeof(uint64_t))
+      return std::nullopt;
+    const auto size = data.size() - sizeof(uint64_t);
+    auto hash = uint64_t{ };
+    std::memcpy(&hash, data.data() + size, sizeof(uint64_t));
+    data.resize(size);
+    if (hash != hash_fnv1a(data))
+      return std::nullopt;
+    return data;
+  }
+  catch (const std::exception&) {
+    return std::nullopt;
+  }
+
+  void read_placement(Reader& reader, Sprite& sprite) {
+    sprite.slice_index = reader.read<int>();
+    sprite.duplicate_of_index = reader.read<int>();
+    sprite.rotated = reader.read<bool>();
+    sprite.trimmed_source_rect = reader.read<Rect>();
+    sprite.trimmed_rect = reader.read<Rect>();
+    sprite.rect = reader.read<Rect>();
+    sprite.bounds = reader.read<Size>();
+    sprite.align.x = reader.read<int>();
+    sprite.align.y = reader.read<int>();
+    sprite.pivot.x = reader.read<real>();
+    sprite.pivot.y = reader.read<real>();
+    sprite.vertices.resize(reader.read<uint32_t>());
+    for (auto& vertex : sprite.vertices)
+      vertex = reader.read<PointF>();
+  }
+} // namespace
+
+uint64_t get_layout_fingerprint(const std::vector<Sprite>& sprites) {
+  auto writer = Writer();
+  writer.write(layout_cache_version);
+
+  auto sheets_written = std::set<const Sheet*>();
+  auto source_stamps = std::map<const Image*, std::string>();
+  for (const auto& sprite : sprites) {
+    if (sprite.sheet && sheets_written.insert(sprite.sheet.get()).second)
+      write_sheet(writer, *sprite.sheet);
+
+    auto it = source_stamps.find(sprite.source.get());
+    if (it == source_stamps.end()) {
+      it = source_stamps.emplace(sprite.source.get(),
+        get_source_stamp(*sprite.source)).first;
+      if (it->second.empty())
+        return 0;
+    }
+    writer.write(std::string_view(it->second));
+    write_sprite(writer, sprite);
+  }
+  return std::max(hash_fnv1a(writer.data()), uint64_t{ 1 });
+}
+
+bool restore_layout(const std::filesystem::path& filename, 
+    uint64_t fingerprint, std::vector<Sprite>& sprites, 
+    std::vector<Slice>& slices) {
+  if (filename.empty() || !fingerprint)
+    return false;
+
+  const auto data = read_layout_file(filename);
+  if (!data)
+    return false;
+
+  auto reader = Reader(*data);
+  if (reader.read<uint32_t>() != layout_cache_magic ||
+      reader.read<uint32_t>() != layout_cache_version ||
+      reader.read<uint64_t>() != fingerprint ||
+      reader.read<uint32_t>() != sprites.size())
+    return false;
+
+  auto sheets = std::map<int, SheetPtr>();
+  for (const auto& sprite : sprites)
+    if (sprite.sheet)
+      sheets.emplace(sprite.sheet->index, sprite.sheet);
+
+  // sprites are still in definition order, restore packed order
+  auto packed = std::vector<Sprite>();
+  packed.reserve(sprites.size());
+  auto restored = std::vector<bool>(sprites.size());
+  for (auto i = size_t{ }; i < sprites.size(); ++i) {
+    const auto index = reader.read<int>();
+    if (reader.failed() || index < 0 || 
+        to_unsigned(index) >= sprites.size() || 
+        restored[to_unsigned(index)])
+      return false;
+    restored[to_unsigned(index)] = true;
+
+    auto sprite = sprites[to_unsigned(index)];
+    if (reader.read<bool>())
+      sprite.sheet = { };
+    read_placement(reader, sprite);
+    reader.read<uint64_t>();
+    if (reader.failed())
+      return false;
+    packed.push_back(std::move(sprite));
+  }
+
+  auto packed_slices = std::vector<Slice>(reader.read<uint32_t>());
+  for (auto& slice : packed_slices) {
+    const auto sheet_index = reader.read<int>();
+    const auto begin = reader.read<uint32_t>();
+    const auto count = reader.read<uint32_t>();
+    slice.sheet_index = reader.read<int>();
+    slice.width = reader.read<int>();
+    slice.height = reader.read<int>();
+    slice.layered = reader.read<bool>();
+    const auto it = sheets.find(sheet_index);
+    if (reader.failed() || it == sheets.end() ||
+        begin > packed.size() || count > packed.size() - begin)
+      return false;
+    slice.sheet = it->second;
+    slice.index = static_cast<int>(&slice - packed_slices.data());
+    slice.sprites = SpriteSpan(packed.data() + begin, count);
+  }
+  if (reader.failed() || !reader.at_end())
+    return false;
+
+  // spans stay valid, since the vector's buffer is moved
+  sprites = std::move(packed);
+  slices = std::move(packed_slices);
+  return true;
+}
+
+PreviousLayout read_previous_layout(const std::filesystem::path& filename,
+    const std::vector<Sprite>& sprites) {
+  if (filename.empty() ||
+      std::none_of(sprites.begin(), sprites.end(), [](const Sprite& sprite) {
+        return (sprite.sheet && sprite.sheet->incremental);
+      }))
+    return { };
+
+  const auto data = read_layout_file(filename);
+  if (!data)
+    return { };
+
+  // fingerprint is not checked
+  auto reader = Reader(*data);
+  if (reader.read<uint32_t>() != layout_cache_magic ||
+      reader.read<uint32_t>() != layout_cache_version)
+    return { };
+  reader.read<uint64_t>();
+
+  auto stored = std::vector<std::pair<uint64_t, PreviousPlacement>>(
+    reader.read<uint32_t>());
+  if (reader.failed() || stored.size() > data->size())
+    return { };
+  auto areas = std::vector<int64_t>(stored.size());
+  for (auto i = size_t{ }; i < stored.size(); ++i) {
+    auto& [key, placement] = stored[i];
+    reader.read<int>();
+    const auto dropped = reader.read<bool>();
+    auto sprite = Sprite{ };
+    read_placement(reader, sprite);
+    const auto stored_key = reader.read<uint64_t>();
+    key = (dropped || sprite.slice_index < 0 ? 0 : stored_key);
+    if (key && sprite.duplicate_of_index < 0)
+      areas[i] = int64_t{ sprite.bounds.x } * sprite.bounds.y;
+    placement.slice_index = sprite.slice_index;
+    placement.position = { sprite.trimmed_rect.x - sprite.align.x,
+                           sprite.trimmed_rect.y - sprite.align.y };
+    placement.bounds = sprite.bounds;
+    placement.rotated = sprite.rotated;
+  }
+
+  const auto slice_count = reader.read<uint32_t>();
+  for (auto i = 0u; i < slice_count && !reader.failed(); ++i) {
+    reader.read<int>();
+    const auto begin = reader.read<uint32_t>();
+    const auto count = reader.read<uint32_t>();
+    const auto sheet_index = reader.read<int>();
+    const auto width = reader.read<int>();
+    const auto height = reader.read<int>();
+    reader.read<bool>();
+    if (begin > stored.size() || count > stored.size() - begin)
+      return { };
+    // sprites store the global slice index, packing uses the sheet's
+    auto used_area = int64_t{ };
+    for (auto j = begin; j < begin + count; ++j)
+      used_area += areas[j];
+    for (auto j = begin; j < begin + count; ++j) {
+      stored[j].second.slice_index = sheet_index;
+      stored[j].second.slice_size = { width, height };
+      stored[j].second.slice_used_area = used_area;
+    }
+  }
+  if (reader.failed() || !reader.at_end())
+    return { };
+
+  auto placements = std::multimap<uint64_t, PreviousPlacement>();
+  for (const auto& [key, placement] : stored)
+    if (key && placement.slice_size.x > 0 && placement.slice_size.y > 0)
+      placements.emplace(key, placement);
+
+  // each stored placement is taken once
+  auto previous_layout = PreviousLayout();
+  for (const auto& sprite : sprites)
+    if (sprite.sheet && sprite.sheet->incremental) {
+      const auto it = placements.find(get_sprite_key(sprite));
+      if (it != placements.end()) {
+        previous_layout[sprite.index] = it->second;
+        placements.erase(it);
+      }
+    }
+  return previous_layout;
+}
+
+void store_layout(const std::filesystem::path& filename, 
+    uint64_t fingerprint, const std::vector<Sprite>& sprites,
+    const std::vector<Slice>& slices) {
+  if (filename.empty())
+    return;
+
+  auto writer = Writer();
+  writer.write(layout_cache_magic);
+  writer.write(layout_cache_version);
+  writer.write(fingerprint);
+  writer.write(static_cast<uint32_t>(sprites.size()));
+  for (const auto& sprite : sprites) {
+    writer.write(sprite.index);
+    writer.write(!sprite.sheet);
+    writer.write(sprite.slice_index);
+    writer.write(sprite.duplicate_of_index);
+    writer.write(sprite.rotated);
+    writer.write(sprite.trimmed_source_rect);
+    writer.write(sprite.trimmed_rect);
+    writer.write(sprite.rect);
+    writer.write(sprite.bounds);
+    writer.write(sprite.align.x);
+    writer.write(sprite.align.y);
+    writer.write(sprite.pivot.x);
+    writer.write(sprite.pivot.y);
+    writer.write(static_cast<uint32_t>(sprite.vertices.size()));
+    for (const auto& vertex : sprite.vertices)
+      writer.write(vertex);
+    writer.write(get_sprite_key(sprite));
+  }
+  writer.write(static_cast<uint32_t>(slices.size()));
+  for (const auto& slice : slices) {
+    writer.write(slice.sheet->index);
+    writer.write(static_cast<uint32_t>(slice.sprites.data() - sprites.data()));
+    writer.write(static_cast<uint32_t>(slice.sprites.size()));
+    writer.write(slice.sheet_index);
+    writer.write(slice.width);
+    writer.write(slice.height);
+    writer.write(slice.layered);
+  }
+  writer.write(hash_fnv1a(writer.data()));
+
+  try {
+    update_textfile(filename, writer.data());
+  }
+  catch (const std::exception&) {
+    // caching is optional
+  }
+}
+
+} // namespace
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "packing.h"
+
+namespace spright {
+
+// identifies everything the layout depends on, 0 when it can not be cached
+uint64_t get_layout_fingerprint(const std::vector<Sprite>& sprites);
+
+// reorders and updates sprites and recreates slices as they were packed
+bool restore_layout(const std::filesystem::path& filename, 
+  uint64_t fingerprint, std::vector<Sprite>& sprites, 
+  std::vector<Slice>& slices);
+
+// placements of sprites in the stored layout, even when it is outdated
+PreviousLayout read_previous_layout(const std::filesystem::path& filename,
+  const std::vector<Sprite>& sprites);
+
+// a layout stored without fingerprint is only read as previous layout
+void store_layout(const std::filesystem::path& filename, 
+  uint64_t fingerprint, const std::vector<Sprite>& sprites,
+  const std::vector<Slice>& slices);
+
+} // namespace
@@ -1,6 +1,7 @@
 
 #include "trimming.h"
 #include "packing.h"
+#include "layout_cache.h"
 #include "output.h"
 #include <iostream>
 #include <chrono>
@@ -16,8 +17,10 @@ int main(int argc, const char* argv[]) try {
     return 1;
   }
 
+  scheduler.configure(settings.threads, settings.affinity_mask);
+
   using Clock = std::chrono::high_resolution_clock;
-  auto time_points = std::vector<std::pair<Clock::time_point, const char*>>();
+  auto time_points = std::vector<std::pair<Clock::time_point, std::string>>();
   time_points.emplace_back(Clock::now(), "begin");
 
   auto [inputs, sprites, descriptions, variables] = parse_definition(settings);  
@@ -27,13 +30,30 @@ int main(int argc, const char* argv[]) try {
   auto textures = std::vector<Texture>();
   if (settings.mode != Mode::autocomplete &&
       settings.mode != Mode::describe_input) {
-    trim_sprites(sprites);
-    time_points.emplace_back(Clock::now(), "trimming");
+    const auto layout_cache = get_cache_filename(settings, ".layout-cache");
+    const auto fingerprint = get_layout_fingerprint(sprites);
+    if (settings.mode != Mode::rebuild &&
+        restore_layout(layout_cache, fingerprint, sprites, slices)) {
+      time_points.emplace_back(Clock::now(), "packing (cached)");
+    }
+    else {
+      const auto warnings_issued = get_warnings_issued();
+      const auto cached_sprites = trim_sprites(sprites, 
+        get_cache_filename(settings, ".trim-cache"), 
+        settings.mode != Mode::rebuild);
+      time_points.emplace_back(Clock::now(), "trimming" + (cached_sprites ? 
+        " (" + std::to_string(cached_sprites) + " cached)" : std::string()));
+
+      slices = pack_sprites(sprites,
+        read_previous_layout(layout_cache, sprites));
+      // layouts with warnings are not restored, to report them again
+      store_layout(layout_cache, (get_warnings_issued() == warnings_issued ?
+        fingerprint : 0), sprites, slices);
+      time_points.emplace_back(Clock::now(), "packing");
+    }
 
-    slices = pack_sprites(sprites);
     textures = get_textures(settings, slices);
     evaluate_expressions(settings, sprites, textures, variables);
-    time_points.emplace_back(Clock::now(), "packing");
 
     if (settings.mode != Mode::describe) {
       if (settings.mode != Mode::rebuild &&
@@ -9,6 +9,9 @@ struct Texture {
   const Output* output;
   std::string filename;
   int map_index;
+  int mip_levels;
+  // files of the levels after the first, unless stored in a texture file
+  std::vector<std::string> mip_filenames;
 };
 
 std::vector<Texture> get_textures(const Settings& settings,
@@ -36,8 +39,13 @@ void output_descriptions(
   const std::vector<Texture>& textures,
   const VariantMap& variables);
 
+// larger slices are composed, processed and written in bands of rows,
+// so the memory required is bounded by the band size
+const auto default_streaming_min_pixels = int64_t{ 4096 } * 4096;
+
 Image get_slice_image(const Slice& slice, int map_index = -1);
 Animation get_slice_animation(const Slice& slice, int map_index = -1);
-void output_textures(std::vector<Texture>& textures);
+void output_textures(std::vector<Texture>& textures,
+  int64_t streaming_min_pixels = default_streaming_min_pixels);
 
 } // namespace
@@ -169,6 +169,23 @@ namespace {
       json_texture["map"] = (texture.map_index < 0 ?
         texture.output->default_map_suffix :
         texture.output->map_suffixes.at(to_unsigned(texture.map_index)));
+      if (texture.mip_levels > 1) {
+        // same rounding as resize_image
+        auto& json_levels = json_texture["mipLevels"];
+        auto width = to_int(slice.width * output.scale + 0.5);
+        auto height = to_int(slice.height * output.scale + 0.5);
+        for (auto i = 0; i < texture.mip_levels; ++i) {
+          // texture files contain all levels
+          auto& json_level = json_levels.emplace_back();
+          if (!texture.mip_filenames.empty())
+            json_level["filename"] = (i == 0 ? texture.filename : 
+              texture.mip_filenames.at(to_unsigned(i - 1)));
+          json_level["width"] = width;
+          json_level["height"] = height;
+          width = std::max(width / 2, 1);
+          height = std::max(height / 2, 1);
+        }
+      }
     }
 
     for (const auto& [key, value] : variables)
@@ -267,6 +284,8 @@ void evaluate_expressions(
   for (auto& texture : textures)
     try {
       evaluate_slice_expression(*texture.slice, texture.filename);
+      for (auto& filename : texture.mip_filenames)
+        evaluate_slice_expression(*texture.slice, filename);
     }
     catch (const std::exception& ex) {
       warning(ex.what(), texture.output->warning_line_number);
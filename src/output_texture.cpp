@@ -1,11 +1,18 @@
 
 #include "output.h"
+#include "png.h"
 #include "globbing.h"
 #include "debug.h"
+#include <limits>
+#include <set>
 
 namespace spright {
 
 namespace {
+  const auto slice_band_height = 64;
+
+  const auto streaming_band_pixels = 1024 * 1024;
+
   const Image* get_source(const Sprite& sprite, int map_index) {
     if (map_index < 0)
       return sprite.source.get();
@@ -25,31 +32,37 @@ namespace {
       v[3] == PointF(0, h));
   }
 
-  bool copy_sprite(Image& target, const Sprite& sprite, int map_index) try {
-    const auto source = get_source(sprite, map_index);
-    if (!source)
-      return false;
-
+  void copy_sprite_rect(Image& target, const Sprite& sprite, 
+      const Image& source, const Rect& source_rect, int dx, int dy,
+      const std::vector<PointF>& vertices) {
     if (sprite.rotated) {
       if (has_rect_vertices(sprite)) {
-        copy_rect_rotated_cw(*source, sprite.trimmed_source_rect,
-          target, sprite.trimmed_rect.x, sprite.trimmed_rect.y);
+        copy_rect_rotated_cw(source, source_rect, target, dx, dy);
       }
       else {
-        copy_rect_rotated_cw(*source, sprite.trimmed_source_rect,
-          target, sprite.trimmed_rect.x, sprite.trimmed_rect.y, sprite.vertices);
+        copy_rect_rotated_cw(source, source_rect, target, dx, dy, vertices);
       }
     }
     else {
       if (has_rect_vertices(sprite)) {
-        copy_rect(*source, sprite.trimmed_source_rect,
-          target, sprite.trimmed_rect.x, sprite.trimmed_rect.y);
+        copy_rect(source, source_rect, target, dx, dy);
       }
       else {
-        copy_rect(*source, sprite.trimmed_source_rect,
-          target, sprite.trimmed_rect.x, sprite.trimmed_rect.y, sprite.vertices);
+        copy_rect(source, source_rect, target, dx, dy, vertices);
       }
     }
+  }
+
+  // the target's top-left corner is at origin on the slice
+  bool copy_sprite(Image& target, const Sprite& sprite, int map_index,
+      const Point& origin = { }) try {
+    const auto source = get_source(sprite, map_index);
+    if (!source)
+      return false;
+
+    copy_sprite_rect(target, sprite, *source, sprite.trimmed_source_rect,
+      sprite.trimmed_rect.x - origin.x, sprite.trimmed_rect.y - origin.y, 
+      sprite.vertices);
 
     if (sprite.extrude.count) {
       const auto left = (sprite.source_rect.x0() == sprite.trimmed_source_rect.x0());
@@ -60,6 +73,8 @@ namespace {
         auto rect = sprite.trimmed_rect;
         if (sprite.rotated)
           std::swap(rect.w, rect.h);
+        rect.x -= origin.x;
+        rect.y -= origin.y;
         extrude_rect(target, rect, 
           sprite.extrude.count, sprite.extrude.mode, 
           left, top, right, bottom);
@@ -77,6 +92,140 @@ namespace {
 #endif
   }
 
+  // copies the part of the sprite within the slice rows [y0, y1), without 
+  // extrusion, to a target which starts at slice row target_y
+  void copy_sprite_rows(Image& target, const Sprite& sprite, 
+      int map_index, int y0, int y1, int target_y = 0) try {
+    const auto source = get_source(sprite, map_index);
+    if (!source)
+      return;
+
+    const auto& rect = sprite.trimmed_rect;
+    const auto height = (sprite.rotated ? rect.w : rect.h);
+    const auto begin = std::max(y0 - rect.y, 0);
+    const auto end = std::min(y1 - rect.y, height);
+    if (begin >= end)
+      return;
+
+    // rows of the target correspond to columns of a rotated source
+    auto source_rect = sprite.trimmed_source_rect;
+    auto offset = PointF();
+    if (sprite.rotated) {
+      source_rect.x += begin;
+      source_rect.w = end - begin;
+      offset.x = begin;
+    }
+    else {
+      source_rect.y += begin;
+      source_rect.h = end - begin;
+      offset.y = begin;
+    }
+    auto vertices = sprite.vertices;
+    if (!has_rect_vertices(sprite))
+      for (auto& vertex : vertices)
+        vertex = vertex - offset;
+
+    copy_sprite_rect(target, sprite, *source, source_rect,
+      rect.x, rect.y + begin - target_y, vertices);
+  }
+  catch (const std::exception& ex) {
+#if defined(NDEBUG)
+    throw;
+#else
+    std::fprintf(stderr, "copying sprite '%s' failed: %s\n", 
+      sprite.id.c_str(), ex.what());
+#endif
+  }
+
+  // the area a sprite writes to, including extrusion
+  Rect get_sprite_target_rect(const Sprite& sprite) {
+    auto rect = sprite.trimmed_rect;
+    if (sprite.rotated)
+      std::swap(rect.w, rect.h);
+    return expand(rect, sprite.extrude.count);
+  }
+
+  bool sprites_overlap(const Slice& slice) {
+    auto rects = std::vector<Rect>();
+    rects.reserve(slice.sprites.size());
+    for (const auto& sprite : slice.sprites)
+      if (auto rect = get_sprite_target_rect(sprite); !empty(rect))
+        rects.push_back(rect);
+    std::sort(rects.begin(), rects.end(),
+      [](const Rect& a, const Rect& b) { return a.x < b.x; });
+    for (auto i = size_t{ }; i < rects.size(); ++i)
+      for (auto j = i + 1; j < rects.size() && rects[j].x < rects[i].x1(); ++j)
+        if (overlapping(rects[i], rects[j]))
+          return true;
+    return false;
+  }
+
+  bool has_extrusion(const Slice& slice) {
+    return std::any_of(slice.sprites.begin(), slice.sprites.end(),
+      [](const Sprite& sprite) { return sprite.extrude.count > 0; });
+  }
+
+  bool has_source(const Slice& slice, int map_index) {
+    return std::any_of(slice.sprites.begin(), slice.sprites.end(), 
+      [&](const Sprite& sprite) { return get_source(sprite, map_index); });
+  }
+
+  // extruded sprites composed for a band, kept for the following bands
+  using ComposedSprites = std::map<const Sprite*, Image>;
+
+  // composes the slice rows [y0, y1), y0 must not decrease between calls
+  Image get_slice_rows(const Slice& slice, int map_index, int y0, int y1,
+      bool overlap, ComposedSprites& composed_sprites) {
+    auto target = Image(slice.width, y1 - y0, RGBA{ });
+    const auto band = Rect{ 0, y0, slice.width, y1 - y0 };
+    auto sprites = std::vector<const Sprite*>();
+    for (const auto& sprite : slice.sprites)
+      if (overlapping(get_sprite_target_rect(sprite), band))
+        sprites.push_back(&sprite);
+
+    if (!overlap) {
+      // release sprites above the band, add entries for the new ones
+      for (auto it = composed_sprites.begin(); it != composed_sprites.end(); )
+        it = (get_sprite_target_rect(*it->first).y1() <= y0 ?
+          composed_sprites.erase(it) : std::next(it));
+      for (const auto sprite : sprites)
+        if (sprite->extrude.count)
+          composed_sprites.try_emplace(sprite);
+
+      // sprites can be copied in any order, extruded sprites are
+      // composed once and their rows within the band copied
+      scheduler.for_each_parallel(sprites, [&](const Sprite* sprite) {
+        if (!sprite->extrude.count)
+          return copy_sprite_rows(target, *sprite, map_index, y0, y1, y0);
+
+        const auto rect = get_sprite_target_rect(*sprite);
+        auto& image = composed_sprites.at(sprite);
+        if (!image) {
+          image = Image(rect.w, rect.h, RGBA{ });
+          if (!copy_sprite(image, *sprite, map_index, { rect.x, rect.y })) {
+            image = { };
+            return;
+          }
+        }
+        const auto rows = intersect(rect, band);
+        copy_rect(image, { 0, rows.y - rect.y, rect.w, rows.h }, 
+          target, rect.x, rows.y - y0);
+      });
+    }
+    else {
+      // copy sprites in order, but each band of rows in parallel
+      const auto bands = static_cast<size_t>(
+        (y1 - y0 + slice_band_height - 1) / slice_band_height);
+      scheduler.for_each_parallel([&](size_t index) {
+        const auto band_y0 = y0 + to_int(index) * slice_band_height;
+        const auto band_y1 = std::min(band_y0 + slice_band_height, y1);
+        for (const auto sprite : sprites)
+          copy_sprite_rows(target, *sprite, map_index, band_y0, band_y1, y0);
+      }, bands);
+    }
+    return target;
+  }
+
   void process_alpha(Image& target, const Output& output) {
     switch (output.alpha) {
       case Alpha::keep:
@@ -95,7 +244,7 @@ namespace {
         break;
 
       case Alpha::premultiply:
-        premultiply_alpha(target);
+        premultiply_alpha(target, output.premultiply_exact);
         break;
 
       case Alpha::colorkey:
@@ -123,6 +272,77 @@ namespace {
       image = resize_image(image, output.scale, output.scale_filter);
   }
 
+  bool can_output_image_rows(const Texture& texture, 
+      int64_t streaming_min_pixels) {
+    const auto& slice = *texture.slice;
+    const auto& output = *texture.output;
+    return (int64_t{ slice.width } * slice.height >= streaming_min_pixels &&
+      to_lower(path_to_utf8(utf8_to_path(texture.filename).extension())) == ".png" &&
+      texture.mip_levels == 1 &&
+      !output.debug &&
+      output.alpha != Alpha::bleed &&
+      !(has_extrusion(slice) && sprites_overlap(slice)));
+  }
+
+  // composes, processes and writes the image in bands of rows
+  bool output_image_rows(const Texture& texture) {
+    // do not return before check if there is a map for slice
+    if (!is_map(texture) && is_up_to_date(texture))
+      return true;
+
+    const auto& slice = *texture.slice;
+    const auto& output = *texture.output;
+    if (!has_source(slice, texture.map_index))
+      return false;
+
+    if (is_map(texture) && is_up_to_date(texture))
+      return true;
+
+    // same size and filter as resize_image
+    const auto width = to_int(slice.width * output.scale + 0.5);
+    const auto height = to_int(slice.height * output.scale + 0.5);
+    const auto scaled = (width != slice.width || height != slice.height);
+    auto filter = output.scale_filter;
+    if (filter == ResizeFilter::undefined && std::fmod(output.scale, 1.0) == 0)
+      filter = ResizeFilter::box;
+    // source rows within the filter support of an output row
+    const auto margin = to_int(std::ceil(2 / std::min(output.scale, 1.0))) + 1;
+
+    const auto filename = utf8_to_path(texture.filename);
+    if (!filename.parent_path().empty())
+      std::filesystem::create_directories(filename.parent_path());
+    auto writer = PngWriter(filename, width, height, 
+      output.compression_level, output.compression_filter);
+    const auto overlap = sprites_overlap(slice);
+    auto composed_sprites = ComposedSprites();
+    const auto band_rows = std::max(streaming_band_pixels / width, 1);
+    for (auto y0 = 0; y0 < height; y0 += band_rows) {
+      const auto y1 = std::min(y0 + band_rows, height);
+      if (!scaled) {
+        auto rows = get_slice_rows(slice, texture.map_index, y0, y1, 
+          overlap, composed_sprites);
+        process_alpha(rows, output);
+        if (!writer.write_rows(rows))
+          error("writing file '", texture.filename, "' failed");
+        continue;
+      }
+      const auto source_y0 = std::max(to_int(y0 / output.scale) - margin, 0);
+      const auto source_y1 = std::min(to_int(y1 / output.scale) + 1 + margin, 
+        slice.height);
+      auto rows = get_slice_rows(slice, texture.map_index,
+        source_y0, source_y1, overlap, composed_sprites);
+      process_alpha(rows, output);
+      auto scaled_rows = Image(width, y1 - y0);
+      resize_image_rows(rows, source_y0, slice.height, 
+        scaled_rows, y0, height, filter);
+      if (!writer.write_rows(scaled_rows))
+        error("writing file '", texture.filename, "' failed");
+    }
+    if (!writer.finish())
+      error("writing file '", texture.filename, "' failed");
+    return true;
+  }
+
   bool output_image(const Texture& texture) {
     // do not return before check if there is a map for slice
     if (!is_map(texture) && is_up_to_date(texture))
@@ -140,7 +360,19 @@ namespace {
     if (texture.output->debug)
       draw_debug_info(image, *texture.slice, texture.output->scale);
 
-    save_image(image, texture.filename);
+    const auto& output = *texture.output;
+    const auto premultiplied = (output.alpha == Alpha::premultiply);
+    auto levels = generate_mip_levels(std::move(image), texture.mip_levels,
+      output.scale_filter, premultiplied);
+    if (is_texture_filename(texture.filename)) {
+      save_texture(levels, texture.filename, output.encoding, premultiplied);
+      return true;
+    }
+    save_image(levels[0], texture.filename, output.compression_level,
+      output.compression_filter);
+    for (auto i = 1u; i < levels.size(); ++i)
+      save_image(levels[i], texture.mip_filenames.at(i - 1), 
+        output.compression_level, output.compression_filter);
     return true;
   }
 
@@ -168,64 +400,146 @@ namespace {
 
     if (texture.output->alpha == Alpha::colorkey)
       animation.color_key = texture.output->alpha_color;
-    save_animation(animation, texture.filename);
+    save_animation(animation, texture.filename, 
+      texture.output->compression_level, texture.output->compression_filter);
     return true;
   }
 
-  bool output_texture(const Texture& texture) {
+  bool output_texture(const Texture& texture, int64_t streaming_min_pixels) {
     if (!texture.slice->layered)
-      return output_image(texture);
+      return (can_output_image_rows(texture, streaming_min_pixels) ?
+        output_image_rows(texture) : output_image(texture));
     return output_animation(texture);
   }
+
+  int get_mip_level_count(const Slice& slice, const Output& output) {
+    if (slice.layered)
+      return 1;
+    auto size = std::max(to_int(slice.width * output.scale + 0.5),
+                         to_int(slice.height * output.scale + 0.5));
+    auto count = 1;
+    for (; size > 1 && count != output.mip_levels; size /= 2)
+      ++count;
+    return count;
+  }
+
+  // foreign pixels must not share a block of 2^level pixels with a
+  // sprite's own pixels, for box filtered levels at unaligned positions
+  bool sprites_apart_on_mip_levels(const Slice& slice, const Output& output,
+      int mip_levels) {
+    if (slice.sprites.size() < 2)
+      return true;
+    auto extrude = std::numeric_limits<int>::max();
+    for (const auto& sprite : slice.sprites)
+      extrude = std::min(extrude, sprite.extrude.count);
+    const auto separation = to_int(
+      (slice.sheet->shape_padding + extrude) * output.scale);
+    return (separation >= (1 << (mip_levels - 1)) - 1);
+  }
 } // namespace
 
 Image get_slice_image(const Slice& slice, int map_index) {
-  auto target = Image(slice.width, slice.height, RGBA{ });
-
-  auto copied_sprite = false;
-  for (const auto& sprite : slice.sprites)
-    copied_sprite |= copy_sprite(target, sprite, map_index);
-  if (!copied_sprite)
+  if (!has_source(slice, map_index))
     return { };
 
+  auto target = Image(slice.width, slice.height, RGBA{ });
+  if (!sprites_overlap(slice)) {
+    // sprites can be copied in any order
+    scheduler.for_each_parallel(slice.sprites,
+      [&](const Sprite& sprite) { copy_sprite(target, sprite, map_index); });
+  }
+  else if (!has_extrusion(slice)) {
+    // copy sprites in order, but each band of rows in parallel
+    const auto band_height = std::max(slice_band_height, 
+      slice.height / (scheduler.thread_count() * 4) + 1);
+    const auto bands = static_cast<size_t>(
+      (slice.height + band_height - 1) / band_height);
+    scheduler.for_each_parallel([&](size_t index) {
+      const auto y0 = to_int(index) * band_height;
+      const auto y1 = std::min(y0 + band_height, slice.height);
+      for (const auto& sprite : slice.sprites)
+        copy_sprite_rows(target, sprite, map_index, y0, y1);
+    }, bands);
+  }
+  else {
+    // extrusion of overlapping sprites depends on order
+    for (const auto& sprite : slice.sprites)
+      copy_sprite(target, sprite, map_index);
+  }
   return target;
 }
 
 Animation get_slice_animation(const Slice& slice, int map_index) {
-  auto animation = Animation();
+  auto sprites = std::vector<const Sprite*>();
   for (const auto& sprite : slice.sprites)
-    if (const auto source = get_source(sprite, map_index)) {
-      auto& frame = animation.frames.emplace_back();
-      frame.index = static_cast<int>(animation.frames.size() - 1);
-      frame.image = Image(slice.width, slice.height, RGBA());
-      copy_sprite(frame.image, sprite, map_index);
-      frame.duration = 0.1;
-    }
+    if (get_source(sprite, map_index))
+      sprites.push_back(&sprite);
+
+  auto animation = Animation();
+  animation.frames.resize(sprites.size());
+  scheduler.for_each_parallel([&](size_t index) {
+    auto& frame = animation.frames[index];
+    frame.index = to_int(index);
+    frame.image = Image(slice.width, slice.height, RGBA());
+    copy_sprite(frame.image, *sprites[index], map_index);
+    frame.duration = 0.1;
+  }, sprites.size());
   return animation;
 }
 
 std::vector<Texture> get_textures(const Settings& settings,
     const std::vector<Slice>& slices) {
   auto textures = std::vector<Texture>();
+  auto warned_outputs = std::set<const Output*>();
   for (const auto& slice : slices)
     for (const auto& output : slice.sheet->outputs) {
+      const auto mip_levels = get_mip_level_count(slice, *output);
+      if (output->mip_levels > 1 &&
+          !sprites_apart_on_mip_levels(slice, *output, mip_levels) &&
+          warned_outputs.insert(output.get()).second)
+        warning("padding and extrude do not keep sprites apart on all mip levels",
+          output->warning_line_number);
+
+      const auto add_texture = [&](const std::filesystem::path& filename, 
+          int map_index) {
+        auto& texture = textures.emplace_back(Texture{ &slice, output.get(), 
+          path_to_utf8(filename), map_index, mip_levels, { } });
+        if (!is_texture_filename(filename))
+          for (auto i = 1; i < mip_levels; ++i)
+            texture.mip_filenames.push_back(path_to_utf8(add_suffix(filename,
+              output->mip_suffix.get_nth_filename(i - 1))));
+      };
+
       const auto filename = settings.output_path / utf8_to_path(
         output->filename.get_nth_filename(slice.sheet_index));
-      textures.push_back({ &slice, output.get(), path_to_utf8(filename), -1 });
+      add_texture(filename, -1);
 
       auto i = 0;
       for (const auto& map_suffix : output->map_suffixes)
-        textures.push_back({ &slice, output.get(), 
-          path_to_utf8(replace_suffix(filename,
-            output->default_map_suffix, map_suffix)), i++ });
+        add_texture(replace_suffix(filename,
+          output->default_map_suffix, map_suffix), i++);
     }
   return textures;
 }
 
-void output_textures(std::vector<Texture>& textures) {
+void output_textures(std::vector<Texture>& textures,
+    int64_t streaming_min_pixels) {
+  // start decoding the sources of the textures, which are written
+  auto sources = std::vector<ImagePtr>();
+  for (const auto& texture : textures)
+    if (!is_up_to_date(texture))
+      for (const auto& sprite : texture.slice->sprites) {
+        if (!is_map(texture))
+          sources.push_back(sprite.source);
+        else if (sprite.maps &&
+            to_unsigned(texture.map_index) < sprite.maps->size())
+          sources.push_back(sprite.maps->at(to_unsigned(texture.map_index)));
+      }
+  prefetch_pixels(sources);
+
   scheduler.for_each_parallel(textures,
     [&](Texture& texture) {
-      if (!output_texture(texture))
+      if (!output_texture(texture, streaming_min_pixels))
         texture.filename = { };
     });
 }
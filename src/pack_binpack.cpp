@@ -4,6 +4,77 @@
 
 namespace spright {
 
+namespace {
+  // heuristics tried in parallel when searching, fastest first.
+  // The composite methods Best and Best_Skyline are not searched,
+  // since they run these heuristics again
+  const auto search_methods = std::vector<rect_pack::Method>{
+    rect_pack::Method::Skyline_BottomLeft,
+    rect_pack::Method::Skyline_BestFit,
+    rect_pack::Method::MaxRects_BottomLeftRule,
+    rect_pack::Method::MaxRects_BestShortSideFit,
+    rect_pack::Method::MaxRects_BestLongSideFit,
+    rect_pack::Method::MaxRects_BestAreaFit,
+    rect_pack::Method::MaxRects_ContactPointRule,
+  };
+
+  using PackSheets = std::vector<rect_pack::Sheet>;
+
+  PackSheets pack_rects(const Sheet& sheet, rect_pack::Method method,
+      std::vector<rect_pack::Size> pack_sizes) {
+    const auto [max_width, max_height] = get_slice_max_size(sheet);
+    return pack(
+      rect_pack::Settings{
+        method,
+        get_max_slice_count(sheet),
+        sheet.power_of_two,
+        sheet.square,
+        sheet.allow_rotate,
+        sheet.divisible_width,
+        sheet.border_padding,
+        sheet.shape_padding,
+        sheet.width,
+        sheet.height,
+        max_width,
+        max_height,
+      },
+      std::move(pack_sizes));
+  }
+
+  // fewest unpacked rects, then like rect_pack's Best fewest sheets,
+  // then smallest total area
+  auto get_score(const PackSheets& pack_sheets, size_t count) {
+    auto unpacked = count;
+    auto area = int64_t{ };
+    for (const auto& pack_sheet : pack_sheets) {
+      unpacked -= pack_sheet.rects.size();
+      area += int64_t{ pack_sheet.width } * pack_sheet.height;
+    }
+    return std::make_tuple(unpacked, pack_sheets.size(), area);
+  }
+
+  // effort 0 only tries the fastest heuristic, each level one more
+  size_t get_search_method_count(const Sheet& sheet) {
+    return std::min(to_unsigned(sheet.pack_effort) + size_t{ 1 },
+      search_methods.size());
+  }
+
+  PackSheets search_best_packing(const Sheet& sheet,
+      const std::vector<rect_pack::Size>& pack_sizes) {
+    const auto count = pack_sizes.size();
+    auto results = std::vector<PackSheets>(get_search_method_count(sheet));
+    scheduler.for_each_parallel([&](size_t index) {
+      results[index] = pack_rects(sheet, search_methods[index], pack_sizes);
+    }, results.size());
+
+    auto best = &results.front();
+    for (auto& result : results)
+      if (get_score(result, count) < get_score(*best, count))
+        best = &result;
+    return std::move(*best);
+  }
+} // namespace
+
 void pack_binpack(const SheetPtr& sheet_ptr, SpriteSpan sprites,
     std::vector<Slice>& slices, bool fast) {
   const auto& sheet = *sheet_ptr;
@@ -18,23 +89,10 @@ void pack_binpack(const SheetPtr& sheet_ptr, SpriteSpan sprites,
     pack_sizes.push_back({ to_int(pack_sizes.size()), size.x, size.y });
   }
 
-  const auto [max_width, max_height] = get_slice_max_size(sheet);
-  const auto pack_sheets = pack(
-    rect_pack::Settings{
-      (fast ? rect_pack::Method::Best_Skyline : rect_pack::Method::Best),
-      get_max_slice_count(sheet),
-      sheet.power_of_two,
-      sheet.square,
-      sheet.allow_rotate,
-      sheet.divisible_width,
-      sheet.border_padding,
-      sheet.shape_padding,
-      sheet.width,
-      sheet.height,
-      max_width,
-      max_height,
-    },
-    std::move(pack_sizes));
+  const auto pack_sheets = (sheet.pack_effort >= 0 ?
+    search_best_packing(sheet, pack_sizes) :
+    pack_rects(sheet, (fast ? rect_pack::Method::Best_Skyline :
+      rect_pack::Method::Best), std::move(pack_sizes)));
 
   // update sprite rects
   auto slice_index = 0;
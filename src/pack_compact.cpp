@@ -1,4 +1,3 @@
-
 #include "packing.h"
 #include "chipmunk/chipmunk.h"
 
@@ -12,7 +11,61 @@ namespace {
   struct FreeBody { void operator()(cpBody* body) { cpBodyFree(body); } };
   using BodyPtr = std::unique_ptr<cpBody, FreeBody>;
 
-  void compact_sprites(const Slice& slice, int border_padding, int shape_padding) {
+  struct GravitySchedule {
+    real gravity;
+    real damping;
+    std::vector<real> sideward_directions;
+  };
+
+  // sprites are pulled up and to the side, which changes direction as
+  // soon as they came to rest
+  const auto gravity_schedules = std::vector<GravitySchedule>{
+    { 400, 0.2, { -1, 1, -1 } },
+    { 400, 0.2, { 1, -1, 1 } },
+    { 100, 0.5, { 0 } },
+  };
+  const auto sideward_gravity = 0.2;
+  const auto time_step = 1.0 / 60;
+  const auto min_phase_steps = 20;
+  const auto max_phase_steps = 100;
+  const auto rest_speed = 8.0;
+  // finally settle with low gravity, to resolve penetrations
+  const auto settle_gravity = 50.0;
+  const auto settle_steps = 60;
+
+  const auto wall_category = cpBitmask{ 1 << 0 };
+  const auto rect_category = cpBitmask{ 1 << 1 };
+  const auto outline_category = cpBitmask{ 1 << 2 };
+
+  struct Layout {
+    std::vector<Point> positions;
+    int64_t area{ };
+  };
+
+  int64_t get_layout_area(const Slice& slice, const std::vector<Point>& positions) {
+    auto max_x = 0;
+    auto max_y = 0;
+    auto i = size_t{ };
+    for (const auto& sprite : slice.sprites) {
+      const auto& position = positions[i++];
+      max_x = std::max(max_x, position.x +
+        (sprite.rotated ? sprite.bounds.y : sprite.bounds.x));
+      max_y = std::max(max_y, position.y +
+        (sprite.rotated ? sprite.bounds.x : sprite.bounds.y));
+    }
+    return int64_t{ max_x } * max_y;
+  }
+
+  Layout get_current_layout(const Slice& slice) {
+    auto layout = Layout{ };
+    for (const auto& sprite : slice.sprites)
+      layout.positions.push_back({ sprite.trimmed_rect.x, sprite.trimmed_rect.y });
+    layout.area = get_layout_area(slice, layout.positions);
+    return layout;
+  }
+
+  Layout compact_sprites(const Slice& slice, int border_padding,
+      int shape_padding, const GravitySchedule& schedule) {
     auto space_ptr = SpacePtr(cpSpaceNew());
     const auto space = space_ptr.get();
 
@@ -23,11 +76,27 @@ namespace {
     const auto x1 = to_real(slice.width) - border - 0.5;
     const auto y1 = to_real(slice.height) - border - 0.5;
 
+    cpSpaceSetDamping(space, schedule.damping);
+
+    // the walls keep the sprites' rects inside, the outlines keep them apart
+    const auto wall_filter = cpShapeFilterNew(CP_NO_GROUP, wall_category, rect_category);
+    const auto rect_filter = cpShapeFilterNew(CP_NO_GROUP, rect_category, wall_category);
+    const auto outline_filter = cpShapeFilterNew(CP_NO_GROUP, outline_category, outline_category);
+
     auto shapes = std::vector<ShapePtr>();
-    shapes.emplace_back(cpSpaceAddShape(space, cpSegmentShapeNew(cpSpaceGetStaticBody(space), cpv(x0, y0), cpv(x1, y0), 0)));
-    shapes.emplace_back(cpSpaceAddShape(space, cpSegmentShapeNew(cpSpaceGetStaticBody(space), cpv(x0, y1), cpv(x1, y1), 0)));
-    shapes.emplace_back(cpSpaceAddShape(space, cpSegmentShapeNew(cpSpaceGetStaticBody(space), cpv(x0, y0), cpv(x0, y1), 0)));
-    shapes.emplace_back(cpSpaceAddShape(space, cpSegmentShapeNew(cpSpaceGetStaticBody(space), cpv(x1, y0), cpv(x1, y1), 0)));
+    const auto add_shape = [&](cpShape* shape, const cpShapeFilter& filter) {
+      cpShapeSetFilter(shape, filter);
+      shapes.emplace_back(cpSpaceAddShape(space, shape));
+    };
+    const auto static_body = cpSpaceGetStaticBody(space);
+    const auto add_wall = [&](real l, real b, real r, real t) {
+      add_shape(cpBoxShapeNew2(static_body, cpBBNew(l, b, r, t), 0), wall_filter);
+    };
+    const auto thickness = to_real(std::max(slice.width, slice.height));
+    add_wall(x0 - thickness, y0 - thickness, x1 + thickness, y0);
+    add_wall(x0 - thickness, y1, x1 + thickness, y1 + thickness);
+    add_wall(x0 - thickness, y0, x0, y1);
+    add_wall(x1, y0, x1 + thickness, y1);
 
     auto bodies = std::vector<BodyPtr>();
     auto vertices = std::vector<cpVect>();
@@ -40,43 +109,93 @@ namespace {
         to_real(sprite.trimmed_rect.y),
       });
 
+      // trimmed rect is not updated yet
+      const auto size = sprite.trimmed_source_rect.size();
       vertices.clear();
       std::transform(begin(sprite.vertices), end(sprite.vertices),
         std::back_inserter(vertices), [&](PointF vertex) {
           if (sprite.rotated)
-            vertex = rotate_cw(vertex, sprite.trimmed_rect.h);
+            vertex = rotate_cw(vertex, to_real(size.y));
           return cpVect{ vertex.x, vertex.y };
         });
-      shapes.emplace_back(cpSpaceAddShape(space, cpPolyShapeNew(body,
-        to_int(vertices.size()), vertices.data(), cpTransformIdentity, padding)));
+      add_shape(cpPolyShapeNew(body, to_int(vertices.size()), vertices.data(),
+        cpTransformIdentity, padding), outline_filter);
+
+      const auto [w, h] = (sprite.rotated ? Size{ size.y, size.x } : size);
+      add_shape(cpBoxShapeNew2(body, cpBBNew(0, 0, to_real(w), to_real(h)),
+        padding), rect_filter);
     }
 
-    // TODO: improve
-    for (auto i = 0; i < 1000; i++) {
-      cpSpaceSetGravity(space, cpVect{ 20.0 * ((i / 100) % 2 ? 1 : -1), -100 });
-      cpSpaceStep(space, 1.0 / 60);
+    const auto at_rest = [&]() {
+      auto kinetic_energy = 0.0;
+      for (const auto& body : bodies)
+        kinetic_energy += cpBodyKineticEnergy(body.get());
+      return (kinetic_energy < 0.5 * rest_speed * rest_speed * to_real(bodies.size()));
+    };
+
+    const auto gravity = schedule.gravity;
+    for (auto direction : schedule.sideward_directions) {
+      cpSpaceSetGravity(space, cpv(direction * sideward_gravity * gravity, -gravity));
+      for (auto i = 0; i < max_phase_steps; ++i) {
+        cpSpaceStep(space, time_step);
+        if (i >= min_phase_steps && at_rest())
+          break;
+      }
     }
+    cpSpaceSetGravity(space, cpv(0, -settle_gravity));
+    for (auto i = 0; i < settle_steps; ++i)
+      cpSpaceStep(space, time_step);
 
-    auto i = 0u;
+    auto layout = Layout{ };
+    layout.positions.reserve(bodies.size());
     for (const auto& body : bodies) {
-      auto& sprite = slice.sprites[i++];
       const auto position = cpBodyGetPosition(body.get());
-      sprite.trimmed_rect.x = to_int(position.x + 0.5);
-      sprite.trimmed_rect.y = to_int(position.y + 0.5);
+      layout.positions.push_back({
+        to_int(position.x + 0.5),
+        to_int(position.y + 0.5),
+      });
     }
+    layout.area = get_layout_area(slice, layout.positions);
 
     // destroy space before shapes
     space_ptr.reset();
+    return layout;
   }
 } // namespace
 
 void pack_compact(const SheetPtr& sheet, SpriteSpan sprites,
     std::vector<Slice>& slices) {
   const auto fast = (sheet->allow_rotate == false);
+  const auto first_slice = slices.size();
   pack_binpack(sheet, sprites, slices, fast);
-  for (auto& slice : slices) {
-    recompute_slice_size(slice);
-    compact_sprites(slice, sheet->border_padding, sheet->shape_padding);
+  const auto slice_count = slices.size() - first_slice;
+  for (auto i = first_slice; i < slices.size(); ++i)
+    recompute_slice_size(slices[i]);
+
+  // compact all slices with each schedule in parallel
+  const auto schedule_count = gravity_schedules.size();
+  auto layouts = std::vector<Layout>(slice_count * schedule_count);
+  scheduler.for_each_parallel([&](size_t index) {
+    const auto& slice = slices[first_slice + index / schedule_count];
+    layouts[index] = compact_sprites(slice, sheet->border_padding,
+      sheet->shape_padding, gravity_schedules[index % schedule_count]);
+  }, layouts.size());
+
+  // keep the tightest layout, which might still be the initial one
+  for (auto i = size_t{ }; i < slice_count; ++i) {
+    auto& slice = slices[first_slice + i];
+    auto best = get_current_layout(slice);
+    for (auto j = size_t{ }; j < schedule_count; ++j) {
+      auto& layout = layouts[i * schedule_count + j];
+      if (layout.area < best.area)
+        best = std::move(layout);
+    }
+    auto position = best.positions.begin();
+    for (auto& sprite : slice.sprites) {
+      sprite.trimmed_rect.x = position->x;
+      sprite.trimmed_rect.y = position->y;
+      ++position;
+    }
   }
 }
 
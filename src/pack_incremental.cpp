@@ -0,0 +1,181 @@
+
+#include "packing.h"
+
+namespace spright {
+
+namespace {
+  // maximal free rectangles, which may overlap each other
+  class FreeSpace {
+  public:
+    explicit FreeSpace(const Rect& area) {
+      if (area.w > 0 && area.h > 0)
+        m_rects.push_back(area);
+    }
+
+    void allocate(const Rect& rect) {
+      auto rects = std::vector<Rect>();
+      auto split = std::vector<Rect>();
+      for (const auto& free : m_rects) {
+        if (!overlapping(free, rect)) {
+          rects.push_back(free);
+          continue;
+        }
+        if (rect.x > free.x)
+          split.push_back({ free.x, free.y, rect.x - free.x, free.h });
+        if (rect.x1() < free.x1())
+          split.push_back({ rect.x1(), free.y, free.x1() - rect.x1(), free.h });
+        if (rect.y > free.y)
+          split.push_back({ free.x, free.y, free.w, rect.y - free.y });
+        if (rect.y1() < free.y1())
+          split.push_back({ free.x, rect.y1(), free.w, free.y1() - rect.y1() });
+      }
+
+      // only the split rectangles can be contained by others
+      for (auto i = size_t{ }; i < split.size(); ++i) {
+        const auto contained = [&](const Rect& other) {
+          return containing(other, split[i]);
+        };
+        if (std::none_of(rects.begin(), rects.end(), contained) &&
+            std::none_of(split.begin(), split.begin() + to_int(i), contained) &&
+            std::none_of(split.begin() + to_int(i) + 1, split.end(),
+              [&](const Rect& other) {
+                return (containing(other, split[i]) && other != split[i]);
+              }))
+          rects.push_back(split[i]);
+      }
+      m_rects = std::move(rects);
+    }
+
+    // best short side fit
+    std::optional<std::pair<Point, int>> find(const Size& size) const {
+      auto best = std::optional<std::pair<Point, int>>();
+      for (const auto& free : m_rects)
+        if (free.w >= size.x && free.h >= size.y) {
+          const auto fit = std::min(free.w - size.x, free.h - size.y);
+          if (!best || fit < best->second)
+            best = { free.xy(), fit };
+        }
+      return best;
+    }
+
+  private:
+    std::vector<Rect> m_rects;
+  };
+
+  Size get_footprint(const Sprite& sprite, bool rotated, int padding) {
+    const auto& bounds = sprite.bounds;
+    return (rotated ?
+      Size{ bounds.y + padding, bounds.x + padding } :
+      Size{ bounds.x + padding, bounds.y + padding });
+  }
+
+  Rect get_footprint_rect(const Sprite& sprite,
+      const PreviousPlacement& placement, int padding) {
+    const auto size = get_footprint(sprite, placement.rotated, padding);
+    return { placement.position.x, placement.position.y, size.x, size.y };
+  }
+} // namespace
+
+bool pack_incremental(const SheetPtr& sheet_ptr, SpriteSpan sprites,
+    std::vector<Slice>& slices, const PreviousLayout& previous_layout) {
+  const auto& sheet = *sheet_ptr;
+  const auto max_slices = get_max_slice_count(sheet);
+  const auto border = sheet.border_padding;
+  const auto padding = sheet.shape_padding;
+
+  // keep sprites, whose bounds did not change
+  auto placements = std::vector<std::optional<PreviousPlacement>>(sprites.size());
+  auto slice_sizes = std::map<int, Size>();
+  auto slice_used_areas = std::map<int, int64_t>();
+  auto new_sprites = std::vector<size_t>();
+  for (auto i = size_t{ }; i < sprites.size(); ++i) {
+    const auto& sprite = sprites[i];
+    const auto it = previous_layout.find(sprite.index);
+    if (it == previous_layout.end() ||
+        !(it->second.bounds == sprite.bounds) ||
+        it->second.slice_index >= max_slices ||
+        (it->second.rotated && !sheet.allow_rotate)) {
+      new_sprites.push_back(i);
+      continue;
+    }
+    placements[i] = it->second;
+    slice_sizes.emplace(it->second.slice_index, it->second.slice_size);
+    slice_used_areas.emplace(it->second.slice_index, it->second.slice_used_area);
+  }
+  if (slice_sizes.empty())
+    return false;
+
+  auto free_spaces = std::map<int, FreeSpace>();
+  for (const auto& [index, size] : slice_sizes)
+    free_spaces.emplace(index, FreeSpace({ border, border,
+      size.x - 2 * border + padding, size.y - 2 * border + padding }));
+  for (auto i = size_t{ }; i < sprites.size(); ++i)
+    if (const auto& placement = placements[i])
+      free_spaces.at(placement->slice_index).allocate(
+        get_footprint_rect(sprites[i], *placement, padding));
+
+  // place new sprites in free space, largest first
+  std::stable_sort(new_sprites.begin(), new_sprites.end(),
+    [&](size_t a, size_t b) {
+      return (int64_t{ sprites[a].bounds.x } * sprites[a].bounds.y >
+              int64_t{ sprites[b].bounds.x } * sprites[b].bounds.y);
+    });
+  for (auto i : new_sprites) {
+    auto& placement = placements[i];
+    for (auto& [index, free_space] : free_spaces) {
+      auto position = free_space.find(get_footprint(sprites[i], false, padding));
+      auto rotated = false;
+      if (sheet.allow_rotate) {
+        const auto rotated_position = free_space.find(
+          get_footprint(sprites[i], true, padding));
+        if (rotated_position && (!position ||
+              rotated_position->second < position->second)) {
+          position = rotated_position;
+          rotated = true;
+        }
+      }
+      if (position) {
+        placement = PreviousPlacement{ index, slice_sizes[index],
+          position->first, sprites[i].bounds, rotated };
+        free_space.allocate(get_footprint_rect(sprites[i], *placement, padding));
+        break;
+      }
+    }
+    // repack when a sprite does not fit
+    if (!placement)
+      return false;
+  }
+
+  // repack when more area became unused than in the previous run,
+  // sheets which were sparse when packed are not repacked every run
+  auto used_area = int64_t{ };
+  for (const auto& sprite : sprites)
+    used_area += int64_t{ sprite.bounds.x } * sprite.bounds.y;
+  auto total_area = int64_t{ };
+  auto previous_used_area = int64_t{ };
+  for (const auto& [index, size] : slice_sizes) {
+    total_area += int64_t{ size.x } * size.y;
+    previous_used_area += slice_used_areas[index];
+  }
+  if ((previous_used_area - used_area) * 100 >
+      total_area * sheet.incremental_max_unused)
+    return false;
+
+  // renumber kept slices, previous slices may have lost all sprites
+  auto slice_indices = std::map<int, int>();
+  for (const auto& [index, size] : slice_sizes)
+    slice_indices.emplace(index, to_int(slice_indices.size()));
+
+  for (auto i = size_t{ }; i < sprites.size(); ++i) {
+    auto& sprite = sprites[i];
+    const auto& placement = *placements[i];
+    sprite.slice_index = slice_indices[placement.slice_index];
+    sprite.rotated = placement.rotated;
+    sprite.trimmed_rect.x = placement.position.x;
+    sprite.trimmed_rect.y = placement.position.y;
+  }
+  create_slices_from_indices(sheet_ptr, sprites, slices);
+  return true;
+}
+
+} // namespace
@@ -0,0 +1,433 @@
+
+#include "packing.h"
+#include <cmath>
+#include <numeric>
+
+namespace spright {
+
+namespace {
+  // horizontal span [x0, x1) of a row
+  struct Span {
+    int x0;
+    int x1;
+  };
+
+  // the rows of a shape, the first row is at y0 relative to the bounds
+  struct Mask {
+    int y0{ };
+    std::vector<Span> rows;
+  };
+
+  struct Orientation {
+    Size bounds;
+    // the pixels which are drawn
+    Mask shape;
+    // the shape expanded by shape padding
+    Mask query;
+  };
+
+  struct NestSprite {
+    Orientation orientations[2];
+    int orientation_count;
+    int64_t area;
+  };
+
+  struct Placement {
+    int slice_index{ -1 };
+    Point position;
+    bool rotated;
+  };
+
+  struct Candidate {
+    std::vector<Placement> placements;
+    int unplaced{ };
+    int64_t area{ };
+  };
+
+  bool is_empty(const Span& span) {
+    return (span.x0 >= span.x1);
+  }
+
+  std::vector<PointF> get_outline(const Sprite& sprite, bool rotated) {
+    const auto size = sprite.trimmed_source_rect.size();
+    auto vertices = sprite.vertices;
+    if (sprite.extrude.count || vertices.size() < 3) {
+      const auto e = to_real(sprite.extrude.count);
+      const auto w = to_real(size.x);
+      const auto h = to_real(size.y);
+      vertices = { { -e, -e }, { w + e, -e }, { w + e, h + e }, { -e, h + e } };
+    }
+    for (auto& vertex : vertices) {
+      if (rotated)
+        vertex = rotate_cw(vertex, to_real(size.y));
+      vertex.x += to_real(sprite.align.x);
+      vertex.y += to_real(sprite.align.y);
+    }
+    return vertices;
+  }
+
+  // conservatively covers all pixels touched by the convex polygon
+  Mask rasterize(const std::vector<PointF>& polygon) {
+    const auto epsilon = 0.001;
+    auto min_y = std::numeric_limits<real>::max();
+    auto max_y = std::numeric_limits<real>::lowest();
+    for (const auto& vertex : polygon) {
+      min_y = std::min(min_y, vertex.y);
+      max_y = std::max(max_y, vertex.y);
+    }
+    auto mask = Mask{ };
+    mask.y0 = static_cast<int>(std::floor(min_y + epsilon));
+    const auto y1 = static_cast<int>(std::ceil(max_y - epsilon));
+    mask.rows.resize(to_unsigned(std::max(y1 - mask.y0, 0)));
+
+    for (auto r = size_t{ }; r < mask.rows.size(); ++r) {
+      const auto top = to_real(mask.y0) + static_cast<real>(r) + epsilon;
+      const auto bottom = top + 1 - 2 * epsilon;
+      auto x0 = std::numeric_limits<real>::max();
+      auto x1 = std::numeric_limits<real>::lowest();
+      for (auto i = size_t{ }; i < polygon.size(); ++i) {
+        const auto& p = polygon[i];
+        const auto& q = polygon[(i + 1) % polygon.size()];
+        const auto lo = std::max(top, std::min(p.y, q.y));
+        const auto hi = std::min(bottom, std::max(p.y, q.y));
+        if (lo > hi)
+          continue;
+        const auto x_at = [&](real y) {
+          return (p.y == q.y ? p.x : p.x + (q.x - p.x) * (y - p.y) / (q.y - p.y));
+        };
+        const auto xa = (p.y == q.y ? p.x : x_at(lo));
+        const auto xb = (p.y == q.y ? q.x : x_at(hi));
+        x0 = std::min({ x0, xa, xb });
+        x1 = std::max({ x1, xa, xb });
+      }
+      if (x0 <= x1)
+        mask.rows[r] = {
+          static_cast<int>(std::floor(x0 + epsilon)),
+          static_cast<int>(std::ceil(x1 - epsilon)),
+        };
+    }
+    return mask;
+  }
+
+  Mask dilate(const Mask& mask, int distance) {
+    if (!distance)
+      return mask;
+    const auto count = static_cast<int>(mask.rows.size());
+    auto result = Mask{ };
+    result.y0 = mask.y0 - distance;
+    result.rows.resize(to_unsigned(count + 2 * distance));
+    for (auto r = 0; r < count; ++r) {
+      const auto& span = mask.rows[to_unsigned(r)];
+      if (is_empty(span))
+        continue;
+      for (auto d = 0; d <= 2 * distance; ++d) {
+        auto& row = result.rows[to_unsigned(r + d)];
+        row = (is_empty(row) ? span : Span{
+          std::min(row.x0, span.x0), std::max(row.x1, span.x1) });
+      }
+    }
+    for (auto& row : result.rows)
+      if (!is_empty(row))
+        row = { row.x0 - distance, row.x1 + distance };
+    return result;
+  }
+
+  int64_t get_mask_area(const Mask& mask) {
+    auto area = int64_t{ };
+    for (const auto& span : mask.rows)
+      if (!is_empty(span))
+        area += span.x1 - span.x0;
+    return area;
+  }
+
+  // the occupied spans of each row of a slice, sorted and disjoint
+  class Occupancy {
+  public:
+    explicit Occupancy(int width) : m_width(width) { }
+
+    // finds the leftmost position in row y, where the mask does not
+    // overlap any occupied span
+    std::optional<int> find_x(const Mask& mask, int y, int x_min, int x_max) const {
+      const auto rows = static_cast<int>(m_rows.size());
+      auto x = x_min;
+      for (auto moved = true; moved; ) {
+        if (x > x_max)
+          return std::nullopt;
+        moved = false;
+        auto row_y = y + mask.y0;
+        for (const auto& span : mask.rows) {
+          const auto ry = row_y++;
+          if (ry < 0 || ry >= rows || is_empty(span))
+            continue;
+          const auto& row = m_rows[to_unsigned(ry)];
+          const auto it = std::upper_bound(row.begin(), row.end(), x + span.x0,
+            [](int value, const Span& span) { return value < span.x1; });
+          if (it != row.end() && it->x0 < x + span.x1) {
+            x = it->x1 - span.x0;
+            moved = true;
+          }
+        }
+      }
+      return x;
+    }
+
+    // quickly rejects rows which do not have a wide enough gap
+    bool may_fit(const Mask& mask, int y) const {
+      const auto rows = static_cast<int>(m_rows.size());
+      auto row_y = y + mask.y0;
+      for (const auto& span : mask.rows) {
+        const auto ry = row_y++;
+        if (ry >= 0 && ry < rows &&
+            m_max_gaps[to_unsigned(ry)] < span.x1 - span.x0)
+          return false;
+      }
+      return true;
+    }
+
+    void insert(const Mask& mask, int x, int y) {
+      const auto end = y + mask.y0 + static_cast<int>(mask.rows.size());
+      if (end > static_cast<int>(m_rows.size())) {
+        m_rows.resize(to_unsigned(end));
+        m_max_gaps.resize(to_unsigned(end), m_width);
+      }
+      auto row_y = y + mask.y0;
+      for (const auto& span : mask.rows) {
+        const auto ry = row_y++;
+        if (ry < 0 || is_empty(span))
+          continue;
+        auto& row = m_rows[to_unsigned(ry)];
+        auto inserted = Span{ x + span.x0, x + span.x1 };
+        // merge with touching spans
+        auto begin = std::lower_bound(row.begin(), row.end(), inserted.x0,
+          [](const Span& span, int value) { return span.x1 < value; });
+        auto it = begin;
+        for (; it != row.end() && it->x0 <= inserted.x1; ++it) {
+          inserted.x0 = std::min(inserted.x0, it->x0);
+          inserted.x1 = std::max(inserted.x1, it->x1);
+        }
+        it = row.erase(begin, it);
+        row.insert(it, inserted);
+        m_max_gaps[to_unsigned(ry)] = get_max_gap(row);
+      }
+    }
+
+    int height() const {
+      return static_cast<int>(m_rows.size());
+    }
+
+  private:
+    int get_max_gap(const std::vector<Span>& row) const {
+      auto max_gap = 0;
+      auto x = 0;
+      for (const auto& span : row) {
+        max_gap = std::max(max_gap, span.x0 - x);
+        x = span.x1;
+      }
+      return std::max(max_gap, m_width - x);
+    }
+
+    int m_width;
+    std::vector<std::vector<Span>> m_rows;
+    std::vector<int> m_max_gaps;
+  };
+
+  NestSprite get_nest_sprite(const Sprite& sprite, const Sheet& sheet) {
+    auto nest_sprite = NestSprite{ };
+    nest_sprite.orientation_count = (sheet.allow_rotate ? 2 : 1);
+    for (auto i = 0; i < nest_sprite.orientation_count; ++i) {
+      const auto rotated = (i == 1);
+      auto& orientation = nest_sprite.orientations[i];
+      orientation.bounds = (rotated ?
+        Size{ sprite.bounds.y, sprite.bounds.x } : sprite.bounds);
+      orientation.shape = rasterize(get_outline(sprite, rotated));
+      orientation.query = dilate(orientation.shape, sheet.shape_padding);
+    }
+    nest_sprite.area = get_mask_area(nest_sprite.orientations[0].query);
+    return nest_sprite;
+  }
+
+  int64_t get_slice_area(const Sheet& sheet, int max_x, int max_y) {
+    auto width = std::max(sheet.width, max_x + sheet.border_padding);
+    auto height = std::max(sheet.height, max_y + sheet.border_padding);
+    if (sheet.divisible_width)
+      width = ceil(width, sheet.divisible_width);
+    if (sheet.power_of_two) {
+      width = ceil_to_pot(width);
+      height = ceil_to_pot(height);
+    }
+    if (sheet.square)
+      width = height = std::max(width, height);
+    return int64_t{ width } * height;
+  }
+
+  // bottom-left fill, sprites are placed in the first slice with space,
+  // at the top-most and then left-most position
+  Candidate nest(const Sheet& sheet,
+      const std::vector<NestSprite>& sprites,
+      const std::vector<size_t>& order, int width, int max_height) {
+    const auto border = sheet.border_padding;
+    const auto max_slices = get_max_slice_count(sheet);
+
+    struct NestSlice {
+      Occupancy occupancy;
+      int max_x;
+      int max_y;
+    };
+    auto slices = std::vector<NestSlice>();
+    auto candidate = Candidate{ };
+    candidate.placements.resize(sprites.size());
+
+    const auto try_place = [&](NestSlice& slice, const NestSprite& sprite,
+        Placement& placement) {
+      auto found = false;
+      auto best = Point{ };
+      for (auto i = 0; i < sprite.orientation_count; ++i) {
+        const auto& orientation = sprite.orientations[i];
+        const auto x_max = width - border - orientation.bounds.x;
+        if (x_max < border)
+          continue;
+        // every position below the occupied rows fits,
+        // a rotation needs to be better
+        auto y_end = std::min(max_height - border - orientation.bounds.y,
+          std::max(border, slice.occupancy.height() - orientation.query.y0));
+        if (found)
+          y_end = std::min(y_end, best.y);
+        for (auto y = border; y <= y_end; ++y) {
+          if (!slice.occupancy.may_fit(orientation.query, y))
+            continue;
+          const auto x = slice.occupancy.find_x(orientation.query, y, border, x_max);
+          if (!x)
+            continue;
+          if (!found || std::tie(y, *x) < std::tie(best.y, best.x)) {
+            found = true;
+            best = { *x, y };
+            placement.rotated = (i == 1);
+          }
+          break;
+        }
+      }
+      if (!found)
+        return false;
+
+      const auto& orientation = sprite.orientations[placement.rotated ? 1 : 0];
+      slice.occupancy.insert(orientation.shape, best.x, best.y);
+      slice.max_x = std::max(slice.max_x, best.x + orientation.bounds.x);
+      slice.max_y = std::max(slice.max_y, best.y + orientation.bounds.y);
+      placement.position = best;
+      return true;
+    };
+
+    for (auto index : order) {
+      const auto& sprite = sprites[index];
+      auto& placement = candidate.placements[index];
+      for (auto i = size_t{ }; i < slices.size(); ++i)
+        if (try_place(slices[i], sprite, placement)) {
+          placement.slice_index = static_cast<int>(i);
+          break;
+        }
+      if (placement.slice_index < 0 &&
+          static_cast<int>(slices.size()) < max_slices) {
+        auto& slice = slices.emplace_back(NestSlice{ Occupancy(width), 0, 0 });
+        if (try_place(slice, sprite, placement))
+          placement.slice_index = static_cast<int>(slices.size() - 1);
+        else
+          slices.pop_back();
+      }
+      if (placement.slice_index < 0)
+        ++candidate.unplaced;
+    }
+
+    for (const auto& slice : slices)
+      candidate.area += get_slice_area(sheet, slice.max_x, slice.max_y);
+    return candidate;
+  }
+
+  std::vector<std::vector<size_t>> get_candidate_orders(
+      const std::vector<NestSprite>& sprites) {
+    using Key = std::function<int64_t(const NestSprite&)>;
+    const auto keys = std::initializer_list<Key>{
+      [](const NestSprite& s) { return s.area; },
+      [](const NestSprite& s) { return int64_t{ s.orientations[0].bounds.y }; },
+      [](const NestSprite& s) { return int64_t{ s.orientations[0].bounds.x }; },
+      [](const NestSprite& s) { return int64_t{ s.orientations[0].bounds.x } *
+                                       s.orientations[0].bounds.y; },
+    };
+    auto orders = std::vector<std::vector<size_t>>();
+    for (const auto& key : keys) {
+      auto& order = orders.emplace_back(sprites.size());
+      std::iota(order.begin(), order.end(), size_t{ });
+      std::stable_sort(order.begin(), order.end(),
+        [&](size_t a, size_t b) { return key(sprites[a]) > key(sprites[b]); });
+    }
+    return orders;
+  }
+
+  std::vector<int> get_candidate_widths(const Sheet& sheet,
+      const std::vector<NestSprite>& sprites, int max_width) {
+    if (sheet.width)
+      return { max_width };
+
+    auto area = int64_t{ };
+    auto min_width = 0;
+    for (const auto& sprite : sprites) {
+      area += sprite.area;
+      auto width = sprite.orientations[0].bounds.x;
+      if (sprite.orientation_count > 1)
+        width = std::min(width, sprite.orientations[1].bounds.x);
+      min_width = std::max(min_width, width);
+    }
+    min_width += 2 * sheet.border_padding;
+
+    const auto estimate = std::sqrt(static_cast<double>(area) / 0.8);
+    auto widths = std::vector<int>();
+    for (auto factor : { 0.8, 0.9, 1.0, 1.1, 1.25 }) {
+      const auto width = std::clamp(static_cast<int>(estimate * factor),
+        std::min(min_width, max_width), max_width);
+      if (std::find(widths.begin(), widths.end(), width) == widths.end())
+        widths.push_back(width);
+    }
+    return widths;
+  }
+} // namespace
+
+void pack_nest(const SheetPtr& sheet_ptr, SpriteSpan sprites,
+    std::vector<Slice>& slices) {
+  const auto& sheet = *sheet_ptr;
+
+  auto nest_sprites = std::vector<NestSprite>(sprites.size());
+  scheduler.for_each_parallel([&](size_t index) {
+    nest_sprites[index] = get_nest_sprite(sprites[index], sheet);
+  }, sprites.size());
+
+  auto [max_width, max_height] = get_slice_max_size(sheet);
+  if (sheet.square)
+    max_width = max_height = std::min(max_width, max_height);
+
+  // try each order with each width in parallel, keep the best
+  const auto orders = get_candidate_orders(nest_sprites);
+  const auto widths = get_candidate_widths(sheet, nest_sprites, max_width);
+  auto candidates = std::vector<Candidate>(orders.size() * widths.size());
+  scheduler.for_each_parallel([&](size_t index) {
+    candidates[index] = nest(sheet, nest_sprites,
+      orders[index / widths.size()], widths[index % widths.size()], max_height);
+  }, candidates.size());
+
+  const auto& best = *std::min_element(candidates.begin(), candidates.end(),
+    [](const Candidate& a, const Candidate& b) {
+      return std::tie(a.unplaced, a.area) < std::tie(b.unplaced, b.area);
+    });
+
+  for (auto i = size_t{ }; i < sprites.size(); ++i) {
+    auto& sprite = sprites[i];
+    const auto& placement = best.placements[i];
+    if (placement.slice_index < 0)
+      continue;
+    sprite.slice_index = placement.slice_index;
+    sprite.rotated = placement.rotated;
+    sprite.trimmed_rect.x = placement.position.x;
+    sprite.trimmed_rect.y = placement.position.y;
+  }
+  create_slices_from_indices(sheet_ptr, sprites, slices);
+}
+
+} // namespace
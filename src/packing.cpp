@@ -133,13 +133,24 @@ namespace {
     s.pivot.y += (pivot_rect.y - s.trimmed_source_rect.y);
   }
 
-  void pack_slice(const SheetPtr& sheet,
-      SpriteSpan sprites, std::vector<Slice>& slices) {
+  bool is_incremental(const Sheet& sheet) {
+    return (sheet.incremental && (sheet.pack == Pack::binpack ||
+      sheet.pack == Pack::compact || sheet.pack == Pack::nest));
+  }
+
+  void pack_slice(const SheetPtr& sheet, SpriteSpan sprites,
+      std::vector<Slice>& slices, const PreviousLayout& previous_layout) {
     assert(!sprites.empty());
 
+    if (is_incremental(*sheet) &&
+        pack_incremental(sheet, sprites, slices, previous_layout))
+      return;
+
     switch (sheet->pack) {
-      case Pack::binpack: return pack_binpack(sheet, sprites, slices, sprites.size() > 1000);
+      case Pack::binpack: return pack_binpack(sheet, sprites, slices,
+        sheet->pack_effort < 0 && sprites.size() > 1000);
       case Pack::compact: return pack_compact(sheet, sprites, slices);
+      case Pack::nest: return pack_nest(sheet, sprites, slices);
       case Pack::single: return pack_single(sheet, sprites, slices);
       case Pack::keep: return pack_keep(sheet, sprites, slices);
       case Pack::rows: return pack_lines(sheet, sprites, slices, true);
@@ -149,28 +160,52 @@ namespace {
     }
   }
 
-  void pack_slice_deduplicate(const SheetPtr& sheet,
-      SpriteSpan sprites, std::vector<Slice>& slices) {
+  void pack_slice_deduplicate(const SheetPtr& sheet, SpriteSpan sprites,
+      std::vector<Slice>& slices, const PreviousLayout& previous_layout) {
     assert(!sprites.empty());
 
-    // sort duplicates to back
+    auto sources = std::vector<ImagePtr>();
+    for (const auto& sprite : sprites)
+      sources.push_back(sprite.source);
+    prefetch_pixels(sources);
+
+    // hash pixels of each sprite once
+    auto hashes = std::vector<uint64_t>(sprites.size());
+    scheduler.for_each_parallel([&](size_t index) {
+      const auto& sprite = sprites[index];
+      hashes[index] = hash_pixels(*sprite.source, sprite.trimmed_source_rect);
+    }, sprites.size());
+
+    // sort duplicates to back, the unique sprites before i do not move,
+    // so only those with an identical hash need to be compared
+    using BucketKey = std::tuple<uint64_t, int, int>;
+    auto buckets = std::map<BucketKey, std::vector<size_t>>();
     auto unique_sprites = sprites;
     for (auto i = size_t{ }; i < unique_sprites.size(); ++i) {
-      for (auto j = size_t{ }; j < i; ++j)
-        if (is_identical(*sprites[i].source, sprites[i].trimmed_source_rect,
-                         *sprites[j].source, sprites[j].trimmed_source_rect)) {
-          sprites[i].duplicate_of_index = sprites[j].index;
-          std::swap(sprites[i--], unique_sprites.back());
-          unique_sprites = unique_sprites.first(unique_sprites.size() - 1);
-          break;
-        }
-       }
+      const auto& rect = sprites[i].trimmed_source_rect;
+      auto& bucket = buckets[{ hashes[i], rect.w, rect.h }];
+      const auto it = std::find_if(bucket.begin(), bucket.end(), 
+        [&](size_t j) {
+          return is_identical(*sprites[i].source, sprites[i].trimmed_source_rect,
+                              *sprites[j].source, sprites[j].trimmed_source_rect);
+        });
+      if (it == bucket.end()) {
+        bucket.push_back(i);
+        continue;
+      }
+      sprites[i].duplicate_of_index = sprites[*it].index;
+      const auto last = unique_sprites.size() - 1;
+      std::swap(sprites[i], sprites[last]);
+      std::swap(hashes[i], hashes[last]);
+      unique_sprites = unique_sprites.first(last);
+      --i;
+    }
 
     // restore order of unique sprites before packing
     std::sort(unique_sprites.begin(), unique_sprites.end(),
       [](const Sprite& a, const Sprite& b) { return (a.index < b.index); });
 
-    pack_slice(sheet, unique_sprites, slices);
+    pack_slice(sheet, unique_sprites, slices, previous_layout);
 
     const auto duplicate_sprites = sprites.last(sprites.size() - unique_sprites.size());
     if (sheet->duplicates == Duplicates::drop) {
@@ -191,7 +226,8 @@ namespace {
     }
   }
 
-  std::vector<Slice> pack_sprites_by_sheet(SpriteSpan sprites) {
+  std::vector<Slice> pack_sprites_by_sheet(SpriteSpan sprites,
+      const PreviousLayout& previous_layout) {
     if (sprites.empty())
       return { };
 
@@ -202,20 +238,37 @@ namespace {
                std::tie(b.sheet->index, b.index);
       });
 
-    auto slices = std::vector<Slice>();
+    auto sheet_sprites = std::vector<SpriteSpan>();
     for (auto begin = sprites.begin(), it = begin; ; ++it)
       if (it == sprites.end() ||
           it->sheet != begin->sheet) {
-        const auto& sheet = begin->sheet;
-        if (sheet->duplicates != Duplicates::keep)
-          pack_slice_deduplicate(sheet, { begin, it }, slices);
-        else
-          pack_slice(sheet, { begin, it }, slices);
-
+        sheet_sprites.emplace_back(begin, it);
         if (it == sprites.end())
           break;
         begin = it;
       }
+
+    // sheets are independent, pack them in parallel
+    auto sheet_slices = std::vector<std::vector<Slice>>(sheet_sprites.size());
+    scheduler.for_each_parallel([&](size_t index) {
+      const auto sprites = sheet_sprites[index];
+      const auto sheet = sprites.front().sheet;
+      if (sheet->duplicates != Duplicates::keep)
+        pack_slice_deduplicate(sheet, sprites, sheet_slices[index], previous_layout);
+      else
+        pack_slice(sheet, sprites, sheet_slices[index], previous_layout);
+    }, sheet_sprites.size());
+
+    // merge in order of sheets, sprites' slice indices become global
+    auto slices = std::vector<Slice>();
+    for (auto i = size_t{ }; i < sheet_slices.size(); ++i) {
+      const auto offset = to_int(slices.size());
+      for (auto& sprite : sheet_sprites[i])
+        if (sprite.slice_index >= 0)
+          sprite.slice_index += offset;
+      auto& sheet = sheet_slices[i];
+      std::move(sheet.begin(), sheet.end(), std::back_inserter(slices));
+    }
     return slices;
   }
 } // namespace
@@ -227,7 +280,8 @@ std::pair<int, int> get_slice_max_size(const Sheet& sheet) {
   };
 }
 
-std::vector<Slice> pack_sprites(std::vector<Sprite>& sprites) {
+std::vector<Slice> pack_sprites(std::vector<Sprite>& sprites,
+    const PreviousLayout& previous_layout) {
   for (auto& sprite : sprites)
     update_sprite_bounds(sprite);
 
@@ -243,7 +297,7 @@ std::vector<Slice> pack_sprites(std::vector<Sprite>& sprites) {
     if (sprite.align_pivot.empty())
       update_sprite_alignment(sprite);
 
-  auto slices = pack_sprites_by_sheet(sprites);
+  auto slices = pack_sprites_by_sheet(sprites, previous_layout);
 
   for (auto& sprite : sprites) {
     update_sprite_rect(sprite);
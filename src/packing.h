@@ -28,18 +28,38 @@ struct Slice {
   std::optional<std::filesystem::file_time_type> last_source_written_time;
 };
 
+// where a sprite was placed by a previous run
+struct PreviousPlacement {
+  int slice_index{ };
+  Size slice_size{ };
+  // position of the bounds
+  Point position{ };
+  Size bounds{ };
+  bool rotated{ };
+  // area of the sprites, which were on the slice
+  int64_t slice_used_area{ };
+};
+
+// previous placements by sprite index
+using PreviousLayout = std::map<int, PreviousPlacement>;
+
 std::pair<int, int> get_slice_max_size(const Sheet& sheet);
 void create_slices_from_indices(const SheetPtr& sheet_ptr, 
     SpriteSpan sprites, std::vector<Slice>& slices);
 void recompute_slice_size(Slice& slice);
 void update_last_source_written_times(std::vector<Slice>& slices);
 
-std::vector<Slice> pack_sprites(std::vector<Sprite>& sprites);
+std::vector<Slice> pack_sprites(std::vector<Sprite>& sprites,
+  const PreviousLayout& previous_layout = { });
 
 void pack_binpack(const SheetPtr& sheet, SpriteSpan sprites,
   std::vector<Slice>& slices, bool fast);
 void pack_compact(const SheetPtr& sheet, SpriteSpan sprites,
   std::vector<Slice>& slices);
+void pack_nest(const SheetPtr& sheet, SpriteSpan sprites,
+  std::vector<Slice>& slices);
+bool pack_incremental(const SheetPtr& sheet, SpriteSpan sprites,
+  std::vector<Slice>& slices, const PreviousLayout& previous_layout);
 void pack_single(const SheetPtr& sheet, SpriteSpan sprites,
   std::vector<Slice>& slices);
 void pack_keep(const SheetPtr& sheet, SpriteSpan sprites,
@@ -0,0 +1,431 @@
+
+#include "png.h"
+#define MINIZ_NO_ZLIB_COMPATIBLE_NAMES
+#include "miniz/miniz.h"
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+
+namespace spright {
+
+namespace {
+  // bands are filtered and deflated in parallel
+  const auto min_band_size = size_t{ 256 * 1024 };
+  const auto bytes_per_pixel = sizeof(RGBA);
+
+  using Buffer = std::vector<uint8_t>;
+
+  struct FileDeleter { void operator()(std::FILE* file) { std::fclose(file); } };
+  using FilePtr = std::unique_ptr<std::FILE, FileDeleter>;
+
+  FilePtr open_file(const std::filesystem::path& filename) {
+#if defined(_WIN32)
+    return FilePtr(_wfopen(filename.wstring().c_str(), L"wb"));
+#else
+    return FilePtr(std::fopen(path_to_utf8(filename).c_str(), "wb"));
+#endif
+  }
+
+  void put_uint32(uint8_t* pos, uint32_t value) {
+    pos[0] = static_cast<uint8_t>(value >> 24);
+    pos[1] = static_cast<uint8_t>(value >> 16);
+    pos[2] = static_cast<uint8_t>(value >> 8);
+    pos[3] = static_cast<uint8_t>(value);
+  }
+
+  bool write_chunk(std::FILE* file, const char* type,
+      const uint8_t* data, size_t size) {
+    auto header = std::array<uint8_t, 8>{ };
+    put_uint32(&header[0], static_cast<uint32_t>(size));
+    std::memcpy(&header[4], type, 4);
+    auto crc = mz_crc32(MZ_CRC32_INIT, &header[4], 4);
+    crc = mz_crc32(crc, data, size);
+    auto footer = std::array<uint8_t, 4>{ };
+    put_uint32(&footer[0], static_cast<uint32_t>(crc));
+    return (std::fwrite(header.data(), header.size(), 1, file) == 1 &&
+            (!size || std::fwrite(data, size, 1, file) == 1) &&
+            std::fwrite(footer.data(), footer.size(), 1, file) == 1);
+  }
+
+  uint8_t paeth_predictor(int a, int b, int c) {
+    const auto p = a + b - c;
+    const auto pa = std::abs(p - a);
+    const auto pb = std::abs(p - b);
+    const auto pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc)
+      return static_cast<uint8_t>(a);
+    if (pb <= pc)
+      return static_cast<uint8_t>(b);
+    return static_cast<uint8_t>(c);
+  }
+
+  // https://www.w3.org/TR/png/#9Filters
+  void filter_row(PngFilter filter, const uint8_t* row, 
+      const uint8_t* prev_row, size_t size, uint8_t* out) {
+    const auto bpp = bytes_per_pixel;
+    switch (filter) {
+      case PngFilter::adaptive:
+      case PngFilter::none:
+        std::memcpy(out, row, size);
+        break;
+
+      case PngFilter::sub:
+        for (auto i = size_t{ }; i < size; ++i)
+          out[i] = static_cast<uint8_t>(row[i] - (i >= bpp ? row[i - bpp] : 0));
+        break;
+
+      case PngFilter::up:
+        for (auto i = size_t{ }; i < size; ++i)
+          out[i] = static_cast<uint8_t>(row[i] - prev_row[i]);
+        break;
+
+      case PngFilter::average:
+        for (auto i = size_t{ }; i < size; ++i)
+          out[i] = static_cast<uint8_t>(row[i] -
+            (((i >= bpp ? row[i - bpp] : 0) + prev_row[i]) >> 1));
+        break;
+
+      case PngFilter::paeth:
+        for (auto i = size_t{ }; i < size; ++i)
+          out[i] = static_cast<uint8_t>(row[i] - (i >= bpp ?
+            paeth_predictor(row[i - bpp], prev_row[i], prev_row[i - bpp]) :
+            prev_row[i]));
+        break;
+    }
+  }
+
+  // minimum sum of absolute differences heuristic
+  int get_filter_cost(const uint8_t* data, size_t size) {
+    auto sum = 0;
+    for (auto i = size_t{ }; i < size; ++i)
+      sum += std::abs(static_cast<int8_t>(data[i]));
+    return sum;
+  }
+
+  // the row before the first row of the image is passed explicitly
+  void filter_rows(const Image& image, int y0, int y1, 
+      PngFilter filter, const uint8_t* first_prev_row, Buffer& filtered) {
+    const auto row_size = to_unsigned(image.width()) * bytes_per_pixel;
+    auto candidate = Buffer(filter == PngFilter::adaptive ? row_size : 0);
+    filtered.resize(to_unsigned(y1 - y0) * (row_size + 1));
+    auto out = filtered.data();
+    for (auto y = y0; y < y1; ++y) {
+      const auto row = reinterpret_cast<const uint8_t*>(
+        image.rgba() + y * image.width());
+      const auto prev_row = (y > 0 ? row - row_size : first_prev_row);
+
+      if (filter == PngFilter::adaptive) {
+        auto best_cost = std::numeric_limits<int>::max();
+        for (auto f : { PngFilter::none, PngFilter::sub, PngFilter::up,
+                        PngFilter::average, PngFilter::paeth }) {
+          filter_row(f, row, prev_row, row_size, candidate.data());
+          const auto cost = get_filter_cost(candidate.data(), row_size);
+          if (cost < best_cost) {
+            best_cost = cost;
+            out[0] = static_cast<uint8_t>(static_cast<int>(f) - 1);
+            std::memcpy(out + 1, candidate.data(), row_size);
+          }
+        }
+      }
+      else {
+        out[0] = static_cast<uint8_t>(static_cast<int>(filter) - 1);
+        filter_row(filter, row, prev_row, row_size, out + 1);
+      }
+      out += row_size + 1;
+    }
+  }
+
+  mz_bool append_to_buffer(const void* data, int size, void* user) {
+    auto& buffer = *static_cast<Buffer*>(user);
+    const auto begin = static_cast<const uint8_t*>(data);
+    buffer.insert(buffer.end(), begin, begin + size);
+    return MZ_TRUE;
+  }
+
+  // raw deflate streams of all but the last band end with a sync flush,
+  // so they can simply be concatenated
+  bool deflate_band(const Buffer& data, int compression_level,
+      bool last_band, Buffer& compressed) {
+    auto compressor = std::make_unique<tdefl_compressor>();
+    const auto flags = tdefl_create_comp_flags_from_zip_params(
+      compression_level, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY);
+    if (tdefl_init(compressor.get(), append_to_buffer, 
+          &compressed, static_cast<int>(flags)) != TDEFL_STATUS_OKAY)
+      return false;
+    const auto status = tdefl_compress_buffer(compressor.get(), 
+      data.data(), data.size(), last_band ? TDEFL_FINISH : TDEFL_SYNC_FLUSH);
+    return (status == (last_band ? TDEFL_STATUS_DONE : TDEFL_STATUS_OKAY));
+  }
+
+  // https://github.com/madler/zlib/blob/master/adler32.c
+  uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t length2) {
+    const auto base = uint32_t{ 65521 };
+    const auto rem = static_cast<uint32_t>(length2 % base);
+    auto sum1 = adler1 & 0xFFFF;
+    auto sum2 = static_cast<uint32_t>((uint64_t{ rem } * sum1) % base);
+    sum1 += (adler2 & 0xFFFF) + base - 1;
+    sum2 += ((adler1 >> 16) & 0xFFFF) + ((adler2 >> 16) & 0xFFFF) + base - rem;
+    if (sum1 >= base) sum1 -= base;
+    if (sum1 >= base) sum1 -= base;
+    if (sum2 >= (base << 1)) sum2 -= (base << 1);
+    if (sum2 >= base) sum2 -= base;
+    return sum1 | (sum2 << 16);
+  }
+
+  uint8_t get_zlib_level_flags(int compression_level) {
+    return (compression_level < 2 ? 0x01 :
+            compression_level < 6 ? 0x5E :
+            compression_level == 6 ? 0x9C : 0xDA);
+  }
+
+  bool write_signature_and_header(std::FILE* file, int width, int height) {
+    const auto signature = std::array<uint8_t, 8>{
+      0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    auto header = std::array<uint8_t, 13>{ };
+    put_uint32(&header[0], static_cast<uint32_t>(width));
+    put_uint32(&header[4], static_cast<uint32_t>(height));
+    header[8] = 8; // bit depth
+    header[9] = 6; // color type RGBA
+    return (std::fwrite(signature.data(), signature.size(), 1, file) == 1 &&
+            write_chunk(file, "IHDR", header.data(), header.size()));
+  }
+
+  // complete zlib stream of the filtered image
+  bool compress_image(const Image& image, int compression_level,
+      PngFilter filter, Buffer& compressed) {
+    auto filtered = Buffer();
+    const auto zero_row = Buffer(to_unsigned(image.width()) * bytes_per_pixel);
+    filter_rows(image, 0, image.height(), filter, zero_row.data(), filtered);
+    compressed = { 0x78, get_zlib_level_flags(compression_level) };
+    if (!deflate_band(filtered, compression_level, true, compressed))
+      return false;
+    const auto adler = static_cast<uint32_t>(
+      mz_adler32(MZ_ADLER32_INIT, filtered.data(), filtered.size()));
+    compressed.resize(compressed.size() + 4);
+    put_uint32(&compressed[compressed.size() - 4], adler);
+    return true;
+  }
+
+  // bounding rect of the pixels which differ
+  Rect get_changed_bounds(const Image& a, const Image& b) {
+    auto min_x = a.width(), max_x = -1, min_y = a.height(), max_y = -1;
+    for (auto y = 0; y < a.height(); ++y) {
+      const auto row_a = a.rgba() + y * a.width();
+      const auto row_b = b.rgba() + y * b.width();
+      auto x0 = 0;
+      while (x0 < a.width() && row_a[x0] == row_b[x0])
+        ++x0;
+      if (x0 == a.width())
+        continue;
+      auto x1 = a.width() - 1;
+      while (row_a[x1] == row_b[x1])
+        --x1;
+      min_x = std::min(min_x, x0);
+      max_x = std::max(max_x, x1);
+      min_y = std::min(min_y, y);
+      max_y = y;
+    }
+    if (max_y < 0)
+      return { };
+    return { min_x, min_y, max_x - min_x + 1, max_y - min_y + 1 };
+  }
+} // namespace
+
+bool write_png(const Image& image, const std::filesystem::path& filename,
+    int compression_level, PngFilter filter) {
+  auto writer = PngWriter(filename, image.width(), image.height(),
+    compression_level, filter);
+  return (writer.write_rows(image) && writer.finish());
+}
+
+PngWriter::PngWriter(const std::filesystem::path& filename, int width, 
+    int height, int compression_level, PngFilter filter)
+  : m_file(open_file(filename).release()),
+    m_width(width),
+    m_height(height),
+    m_compression_level(compression_level),
+    m_filter(filter),
+    m_prev_row(to_unsigned(width) * bytes_per_pixel) {
+  m_failed = (!m_file || !write_signature_and_header(m_file, width, height));
+}
+
+PngWriter::~PngWriter() {
+  if (m_file)
+    std::fclose(m_file);
+}
+
+bool PngWriter::write_rows(const Image& image) {
+  if (m_failed || image.width() != m_width || 
+      m_rows_written + image.height() > m_height)
+    return false;
+
+  const auto row_size = to_unsigned(image.width()) * bytes_per_pixel + 1;
+  const auto height = image.height();
+  const auto min_band_rows = to_int(std::max(min_band_size / row_size, size_t{ 1 }));
+  const auto band_rows = std::max(
+    height / (scheduler.thread_count() * 4), min_band_rows);
+  const auto band_count = static_cast<size_t>((height + band_rows - 1) / band_rows);
+  const auto first_rows = (m_rows_written == 0);
+  const auto last_rows = (m_rows_written + height == m_height);
+
+  struct Band {
+    Buffer compressed;
+    uint32_t adler;
+    size_t size;
+    bool done;
+  };
+  auto bands = std::vector<Band>(band_count);
+  auto mutex = std::mutex();
+  auto next_band = size_t{ };
+  auto failed = false;
+
+  // stream compressed bands to file in order, as soon as they are available
+  const auto write_completed_bands = [&]() {
+    for (; next_band < band_count && bands[next_band].done; ++next_band) {
+      auto& band = bands[next_band];
+      failed = failed || !write_chunk(m_file, "IDAT", 
+        band.compressed.data(), band.compressed.size());
+      band.compressed = { };
+    }
+  };
+
+  scheduler.for_each_parallel([&](size_t index) {
+    const auto y0 = to_int(index) * band_rows;
+    const auto y1 = std::min(y0 + band_rows, height);
+    auto filtered = Buffer();
+    filter_rows(image, y0, y1, m_filter, m_prev_row.data(), filtered);
+
+    auto compressed = Buffer();
+    if (index == 0 && first_rows)
+      compressed = { 0x78, get_zlib_level_flags(m_compression_level) };
+    const auto last_band = (index == band_count - 1 && last_rows);
+    const auto succeeded = deflate_band(filtered, 
+      m_compression_level, last_band, compressed);
+    const auto adler = static_cast<uint32_t>(
+      mz_adler32(MZ_ADLER32_INIT, filtered.data(), filtered.size()));
+
+    auto lock = std::lock_guard(mutex);
+    auto& band = bands[index];
+    band.compressed = std::move(compressed);
+    band.adler = adler;
+    band.size = filtered.size();
+    band.done = true;
+    failed = failed || !succeeded;
+    write_completed_bands();
+  }, band_count);
+
+  for (const auto& band : bands)
+    m_adler = adler32_combine(m_adler, band.adler, band.size);
+  if (height > 0)
+    std::memcpy(m_prev_row.data(), image.rgba() + (height - 1) * m_width, 
+      m_prev_row.size());
+  m_rows_written += height;
+  m_failed = failed;
+  return !failed;
+}
+
+bool PngWriter::finish() {
+  if (m_failed || m_rows_written != m_height)
+    return false;
+  auto trailer = std::array<uint8_t, 4>{ };
+  put_uint32(&trailer[0], m_adler);
+  return (write_chunk(m_file, "IDAT", trailer.data(), trailer.size()) &&
+    write_chunk(m_file, "IEND", nullptr, 0));
+}
+
+// https://wiki.mozilla.org/APNG_Specification
+bool write_apng(const Animation& animation, const std::filesystem::path& filename,
+    int compression_level, PngFilter filter) {
+  const auto& frames = animation.frames;
+  if (frames.empty())
+    return false;
+  const auto width = frames.front().image.width();
+  const auto height = frames.front().image.height();
+
+  // only the region which changed since the previous frame is encoded,
+  // the frames are compressed in parallel
+  struct EncodedFrame {
+    Rect rect;
+    Buffer compressed;
+  };
+  auto encoded = std::vector<EncodedFrame>(frames.size());
+  auto failed = std::atomic<bool>{ };
+  scheduler.for_each_parallel([&](size_t index) {
+    const auto& image = frames[index].image;
+    auto& frame = encoded[index];
+    if (image.width() != width || image.height() != height) {
+      failed = true;
+      return;
+    }
+    frame.rect = image.bounds();
+    if (index > 0) {
+      frame.rect = get_changed_bounds(image, frames[index - 1].image);
+      // write a single pixel to keep the delay
+      if (empty(frame.rect))
+        frame.rect = { 0, 0, 1, 1 };
+    }
+    const auto succeeded = (frame.rect == image.bounds() ?
+      compress_image(image, compression_level, filter, frame.compressed) :
+      compress_image(image.clone(frame.rect), compression_level, 
+        filter, frame.compressed));
+    if (!succeeded)
+      failed = true;
+  }, frames.size());
+  if (failed)
+    return false;
+
+  const auto file = open_file(filename);
+  if (!file || !write_signature_and_header(file.get(), width, height))
+    return false;
+
+  auto animation_control = std::array<uint8_t, 8>{ };
+  put_uint32(&animation_control[0], static_cast<uint32_t>(frames.size()));
+  put_uint32(&animation_control[4], static_cast<uint32_t>(
+    animation.loop_count < 0 ? 1 : animation.loop_count));
+  if (!write_chunk(file.get(), "acTL", 
+        animation_control.data(), animation_control.size()))
+    return false;
+
+  auto sequence_number = uint32_t{ };
+  for (auto index = size_t{ }; index < frames.size(); ++index) {
+    const auto& [rect, compressed] = encoded[index];
+    const auto delay = std::clamp(static_cast<int>(
+      std::lround(frames[index].duration * 1000)), 0, 0xFFFF);
+    auto frame_control = std::array<uint8_t, 26>{ };
+    put_uint32(&frame_control[0], sequence_number++);
+    put_uint32(&frame_control[4], static_cast<uint32_t>(rect.w));
+    put_uint32(&frame_control[8], static_cast<uint32_t>(rect.h));
+    put_uint32(&frame_control[12], static_cast<uint32_t>(rect.x));
+    put_uint32(&frame_control[16], static_cast<uint32_t>(rect.y));
+    frame_control[20] = static_cast<uint8_t>(delay >> 8);
+    frame_control[21] = static_cast<uint8_t>(delay);
+    frame_control[22] = static_cast<uint8_t>(1000 >> 8);
+    frame_control[23] = static_cast<uint8_t>(1000 & 0xFF);
+    frame_control[24] = 0; // dispose none
+    frame_control[25] = 0; // blend source
+    if (!write_chunk(file.get(), "fcTL", 
+          frame_control.data(), frame_control.size()))
+      return false;
+
+    if (index == 0) {
+      if (!write_chunk(file.get(), "IDAT", compressed.data(), compressed.size()))
+        return false;
+    }
+    else {
+      auto frame_data = Buffer(4 + compressed.size());
+      put_uint32(&frame_data[0], sequence_number++);
+      std::memcpy(&frame_data[4], compressed.data(), compressed.size());
+      if (!write_chunk(file.get(), "fdAT", frame_data.data(), frame_data.size()))
+        return false;
+    }
+  }
+  return write_chunk(file.get(), "IEND", nullptr, 0);
+}
+
+} // namespace
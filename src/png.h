@@ -0,0 +1,37 @@
+#pragma once
+
+#include "image.h"
+#include <cstdio>
+
+namespace spright {
+
+bool write_png(const Image& image, const std::filesystem::path& filename,
+  int compression_level, PngFilter filter);
+bool write_apng(const Animation& animation, const std::filesystem::path& filename,
+  int compression_level, PngFilter filter);
+
+// writes a PNG file from consecutive bands of rows
+class PngWriter {
+public:
+  PngWriter(const std::filesystem::path& filename, int width, int height,
+    int compression_level, PngFilter filter);
+  PngWriter(const PngWriter&) = delete;
+  PngWriter& operator=(const PngWriter&) = delete;
+  ~PngWriter();
+
+  bool write_rows(const Image& rows);
+  bool finish();
+
+private:
+  std::FILE* m_file{ };
+  int m_width{ };
+  int m_height{ };
+  int m_compression_level{ };
+  PngFilter m_filter{ };
+  int m_rows_written{ };
+  std::vector<uint8_t> m_prev_row;
+  uint32_t m_adler{ 1 }; // of no data
+  bool m_failed{ };
+};
+
+} // namespace
@@ -4,10 +4,38 @@
 #include <algorithm>
 #include <iostream>
 #include <iterator>
+#include <cstdlib>
+#include <limits>
 
 namespace spright {
 
+namespace {
+  bool parse_threads(Settings& settings, const char* string) {
+    auto end = static_cast<char*>(nullptr);
+    const auto threads = std::strtol(string, &end, 10);
+    if (threads <= 0 || threads > std::numeric_limits<int>::max() || *end)
+      return false;
+    settings.threads = static_cast<int>(threads);
+    return true;
+  }
+
+  bool parse_affinity_mask(Settings& settings, const char* string) {
+    auto end = static_cast<char*>(nullptr);
+    const auto mask = std::strtoull(string, &end, 0);
+    if (!mask || *end)
+      return false;
+    settings.affinity_mask = mask;
+    return true;
+  }
+} // namespace
+
 bool interpret_commandline(Settings& settings, int argc, const char* argv[]) {
+  // environment variables can be overridden by arguments
+  if (auto threads = std::getenv("SPRIGHT_THREADS"))
+    parse_threads(settings, threads);
+  if (auto mask = std::getenv("SPRIGHT_AFFINITY"))
+    parse_affinity_mask(settings, mask);
+
   for (auto i = 1; i < argc; i++) {
     const auto argument = std::string_view(argv[i]);
     if (argument == "-m" || argument == "--mode") {
@@ -54,6 +82,14 @@ bool interpret_commandline(Settings& settings, int argc, const char* argv[]) {
     else if (argument == "-v" || argument == "--verbose") {
       settings.verbose = true;
     }
+    else if (argument == "--threads") {
+      if (++i >= argc || !parse_threads(settings, argv[i]))
+        return false;
+    }
+    else if (argument == "--affinity") {
+      if (++i >= argc || !parse_affinity_mask(settings, argv[i]))
+        return false;
+    }
     else {
       return false;
     }
@@ -74,6 +110,17 @@ bool interpret_commandline(Settings& settings, int argc, const char* argv[]) {
   return true;
 }
 
+std::filesystem::path get_cache_filename(const Settings& settings, 
+    std::string_view extension) {
+  // keep cache files next to output description
+  if (settings.output_file.empty() ||
+      settings.output_file == "stdout")
+    return { };
+  auto filename = settings.output_path / settings.output_file;
+  filename += utf8_to_path(extension);
+  return filename;
+}
+
 void print_help_message(const char* argv0) {
   auto program = std::string_view(argv0);
   if (auto i = program.rfind('/'); i != std::string::npos)
@@ -106,6 +153,8 @@ void print_help_message(const char* argv0) {
     "  -t, --template <file>   template for the output description.\n"
     "  -p, --path <path>       path to prepend to all output files.\n"
     "  -v, --verbose           enable verbose messages.\n"
+    "  --threads <count>       number of threads (default: all hardware threads).\n"
+    "  --affinity <mask>       restrict threads to CPUs in mask (e.g. 0xF0).\n"
     "  -h, --help              print this help.\n"
     "\n"
     "All Rights Reserved.\n"
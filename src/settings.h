@@ -2,6 +2,7 @@
 
 #include <filesystem>
 #include <vector>
+#include <cstdint>
 
 namespace spright {
 
@@ -25,9 +26,13 @@ struct Settings {
   std::filesystem::path template_file;
   std::string autocomplete_pattern;
   bool verbose{ };
+  int threads{ };
+  uint64_t affinity_mask{ };
 };
 
 bool interpret_commandline(Settings& settings, int argc, const char* argv[]);
+std::filesystem::path get_cache_filename(const Settings& settings, 
+  std::string_view extension);
 void print_help_message(const char* argv0);
 
 } // namespace
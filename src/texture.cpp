@@ -0,0 +1,933 @@
+#include "texture.h"
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace spright {
+
+namespace {
+  using Buffer = std::vector<uint8_t>;
+  using Color = std::array<float, 4>;
+
+  struct FileDeleter { void operator()(std::FILE* file) { std::fclose(file); } };
+  using FilePtr = std::unique_ptr<std::FILE, FileDeleter>;
+
+  FilePtr open_file(const std::filesystem::path& filename) {
+#if defined(_WIN32)
+    return FilePtr(_wfopen(filename.wstring().c_str(), L"wb"));
+#else
+    return FilePtr(std::fopen(path_to_utf8(filename).c_str(), "wb"));
+#endif
+  }
+
+  template<typename T>
+  void put_le(Buffer& buffer, T value) {
+    for (auto i = 0u; i < sizeof(T); ++i)
+      buffer.push_back(static_cast<uint8_t>(
+        static_cast<uint64_t>(value) >> (i * 8)));
+  }
+
+  int get_block_size(TextureEncoding encoding) {
+    switch (encoding) {
+      case TextureEncoding::uncompressed: break;
+      case TextureEncoding::bc1: return 8;
+      case TextureEncoding::bc3: return 16;
+      case TextureEncoding::bc7: return 16;
+      case TextureEncoding::etc2: return 8;
+      case TextureEncoding::etc2_eac: return 16;
+    }
+    return 0;
+  }
+
+  Color to_color(const RGBA& rgba) {
+    return { rgba.r * 1.0f, rgba.g * 1.0f, rgba.b * 1.0f, rgba.a * 1.0f };
+  }
+
+  float distance_squared(const Color& a, const Color& b, int channels) {
+    auto sum = 0.0f;
+    for (auto i = 0u; i < static_cast<unsigned>(channels); ++i)
+      sum += (a[i] - b[i]) * (a[i] - b[i]);
+    return sum;
+  }
+
+  // end points of the principal axis through the colors
+  void fit_end_points(const Color* colors, int count, int channels,
+      Color& e0, Color& e1) {
+    const auto n = static_cast<unsigned>(channels);
+    auto mean = Color{ };
+    for (auto c = 0; c < count; ++c)
+      for (auto i = 0u; i < n; ++i)
+        mean[i] += colors[c][i] / static_cast<float>(count);
+
+    auto covariance = std::array<Color, 4>{ };
+    for (auto c = 0; c < count; ++c)
+      for (auto i = 0u; i < n; ++i)
+        for (auto j = 0u; j < n; ++j)
+          covariance[i][j] += (colors[c][i] - mean[i]) * (colors[c][j] - mean[j]);
+
+    // power iteration, starting at the bounding box diagonal
+    auto axis = Color{ };
+    for (auto i = 0u; i < n; ++i)
+      axis[i] = 1;
+    for (auto iteration = 0; iteration < 8; ++iteration) {
+      auto next = Color{ };
+      auto length = 0.0f;
+      for (auto i = 0u; i < n; ++i) {
+        for (auto j = 0u; j < n; ++j)
+          next[i] += covariance[i][j] * axis[j];
+        length = std::max(length, std::fabs(next[i]));
+      }
+      if (length < 1e-6f)
+        break;
+      for (auto i = 0u; i < n; ++i)
+        axis[i] = next[i] / length;
+    }
+
+    auto min = std::numeric_limits<float>::max();
+    auto max = std::numeric_limits<float>::lowest();
+    for (auto c = 0; c < count; ++c) {
+      auto t = 0.0f;
+      for (auto i = 0u; i < n; ++i)
+        t += (colors[c][i] - mean[i]) * axis[i];
+      min = std::min(min, t);
+      max = std::max(max, t);
+    }
+    auto length = 0.0f;
+    for (auto i = 0u; i < n; ++i)
+      length += axis[i] * axis[i];
+    if (length > 0) {
+      min /= length;
+      max /= length;
+    }
+    for (auto i = 0u; i < n; ++i) {
+      e0[i] = std::clamp(mean[i] + axis[i] * min, 0.0f, 255.0f);
+      e1[i] = std::clamp(mean[i] + axis[i] * max, 0.0f, 255.0f);
+    }
+  }
+
+  uint16_t to_565(const Color& color) {
+    const auto quantize = [](float value, int max) {
+      return static_cast<unsigned>(std::lround(value * static_cast<float>(max) / 255.0f));
+    };
+    return static_cast<uint16_t>((quantize(color[0], 31) << 11) |
+      (quantize(color[1], 63) << 5) | quantize(color[2], 31));
+  }
+
+  Color from_565(uint16_t value) {
+    const auto r = (value >> 11) & 31;
+    const auto g = (value >> 5) & 63;
+    const auto b = value & 31;
+    return { static_cast<float>((r << 3) | (r >> 2)),
+             static_cast<float>((g << 2) | (g >> 4)),
+             static_cast<float>((b << 3) | (b >> 2)), 255 };
+  }
+
+  Color interpolate(const Color& a, const Color& b, int wa, int wb) {
+    auto color = Color{ };
+    for (auto i = 0u; i < 4; ++i)
+      color[i] = std::floor((a[i] * static_cast<float>(wa) +
+        b[i] * static_cast<float>(wb)) / static_cast<float>(wa + wb));
+    return color;
+  }
+
+  // end points minimizing the squared error for the given interpolation
+  // weights of the colors, returns false when all weights are equal
+  bool refine_end_points(const Color* colors, const float* weights,
+      int count, Color& e0, Color& e1) {
+    auto a = 0.0f, b = 0.0f, c = 0.0f;
+    auto rhs0 = Color{ }, rhs1 = Color{ };
+    for (auto i = 0; i < count; ++i) {
+      const auto t = weights[i];
+      a += (1 - t) * (1 - t);
+      b += t * (1 - t);
+      c += t * t;
+      for (auto j = 0u; j < 4; ++j) {
+        rhs0[j] += (1 - t) * colors[i][j];
+        rhs1[j] += t * colors[i][j];
+      }
+    }
+    const auto det = a * c - b * b;
+    if (std::fabs(det) < 1e-6f)
+      return false;
+    for (auto j = 0u; j < 4; ++j) {
+      e0[j] = std::clamp((c * rhs0[j] - b * rhs1[j]) / det, 0.0f, 255.0f);
+      e1[j] = std::clamp((a * rhs1[j] - b * rhs0[j]) / det, 0.0f, 255.0f);
+    }
+    return true;
+  }
+
+  // https://learn.microsoft.com/en-us/windows/win32/direct3d10/d3d10-graphics-programming-guide-resources-block-compression
+  void encode_color_block(const RGBA* pixels, uint8_t* out, bool allow_alpha) {
+    // the color of transparent pixels does not matter
+    const auto is_transparent = [&](int i) {
+      return (allow_alpha ? pixels[i].a < 128 : pixels[i].a == 0);
+    };
+    auto colors = std::array<Color, 16>{ };
+    auto count = 0;
+    for (auto i = 0; i < 16; ++i)
+      if (!is_transparent(i))
+        colors[static_cast<size_t>(count++)] = to_color(pixels[i]);
+    const auto has_transparent = (allow_alpha && count < 16);
+
+    struct Candidate {
+      uint16_t c0, c1;
+      uint32_t indices;
+      float error;
+      std::array<float, 16> weights;
+    };
+    const auto evaluate = [&](uint16_t c0, uint16_t c1) {
+      // four color mode requires c0 > c1, three color mode c0 <= c1
+      if (has_transparent ? (c0 > c1) : (c0 < c1))
+        std::swap(c0, c1);
+      const auto p0 = from_565(c0);
+      const auto p1 = from_565(c1);
+      const auto four_colors = (c0 > c1);
+      const auto palette = (four_colors ?
+        std::array<Color, 4>{ p0, p1, interpolate(p0, p1, 2, 1), interpolate(p0, p1, 1, 2) } :
+        std::array<Color, 4>{ p0, p1, interpolate(p0, p1, 1, 1), Color{ } });
+      const auto palette_weights = (four_colors ?
+        std::array<float, 4>{ 0, 1, 1 / 3.0f, 2 / 3.0f } :
+        std::array<float, 4>{ 0, 1, 0.5f, 0 });
+
+      auto candidate = Candidate{ c0, c1, 0, 0, { } };
+      auto color_index = 0u;
+      for (auto i = 0; i < 16; ++i) {
+        auto best = (has_transparent ? 3u : 0u);
+        if (!is_transparent(i)) {
+          const auto color = to_color(pixels[i]);
+          auto best_distance = std::numeric_limits<float>::max();
+          for (auto p = 0u; p < (four_colors ? 4u : 3u); ++p) {
+            const auto distance = distance_squared(color, palette[p], 3);
+            if (distance < best_distance) {
+              best_distance = distance;
+              best = p;
+            }
+          }
+          candidate.error += best_distance;
+          candidate.weights[color_index++] = palette_weights[best];
+        }
+        candidate.indices |= best << (i * 2);
+      }
+      return candidate;
+    };
+
+    auto best = evaluate(0, 0);
+    if (count) {
+      auto e0 = Color{ }, e1 = Color{ };
+      fit_end_points(colors.data(), count, 3, e0, e1);
+      best = evaluate(to_565(e0), to_565(e1));
+      for (auto iteration = 0; iteration < 2 && best.error > 0; ++iteration) {
+        if (!refine_end_points(colors.data(), best.weights.data(), count, e0, e1))
+          break;
+        const auto candidate = evaluate(to_565(e0), to_565(e1));
+        if (candidate.error >= best.error)
+          break;
+        best = candidate;
+      }
+    }
+    out[0] = static_cast<uint8_t>(best.c0);
+    out[1] = static_cast<uint8_t>(best.c0 >> 8);
+    out[2] = static_cast<uint8_t>(best.c1);
+    out[3] = static_cast<uint8_t>(best.c1 >> 8);
+    for (auto i = 0; i < 4; ++i)
+      out[4 + i] = static_cast<uint8_t>(best.indices >> (i * 8));
+  }
+
+  void encode_alpha_block(const RGBA* pixels, uint8_t* out) {
+    auto a0 = 0;
+    auto a1 = 255;
+    for (auto i = 0; i < 16; ++i) {
+      a0 = std::max(a0, int{ pixels[i].a });
+      a1 = std::min(a1, int{ pixels[i].a });
+    }
+    // eight alpha values when a0 > a1
+    auto palette = std::array<int, 8>{ a0, a1 };
+    for (auto i = 1; i < 7; ++i)
+      palette[static_cast<size_t>(i + 1)] = ((7 - i) * a0 + i * a1) / 7;
+
+    auto indices = uint64_t{ };
+    if (a0 > a1)
+      for (auto i = 0; i < 16; ++i) {
+        auto best = 0u;
+        for (auto p = 1u; p < 8; ++p)
+          if (std::abs(palette[p] - pixels[i].a) <
+              std::abs(palette[best] - pixels[i].a))
+            best = p;
+        indices |= uint64_t{ best } << (i * 3);
+      }
+    out[0] = static_cast<uint8_t>(a0);
+    out[1] = static_cast<uint8_t>(a1);
+    for (auto i = 0; i < 6; ++i)
+      out[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+  }
+
+  class BitWriter {
+  public:
+    explicit BitWriter(uint8_t* out) : m_out(out) {
+      std::memset(m_out, 0x00, 16);
+    }
+
+    void put(unsigned value, int bits) {
+      for (auto i = 0; i < bits; ++i, ++m_position)
+        if (value & (1u << i))
+          m_out[m_position / 8] |= static_cast<uint8_t>(1u << (m_position % 8));
+    }
+
+  private:
+    uint8_t* m_out;
+    int m_position{ };
+  };
+
+  // quantized end point, with the encoded bits and the value they expand to
+  struct EndPoint {
+    std::array<unsigned, 4> bits;
+    unsigned p_bit;
+    Color value;
+  };
+
+  struct LineFit {
+    EndPoint e0, e1;
+    std::array<unsigned, 16> indices;
+    float error;
+  };
+
+  // fits a line through the first channels of the block's colors,
+  // with the interpolation weights (of 64) of a BC7 index precision
+  template<typename Quantize> // EndPoint(const Color&)
+  LineFit fit_line(const Color* colors, int channels,
+      const std::vector<int>& weights, Quantize&& quantize) {
+    const auto evaluate = [&](const Color& e0, const Color& e1,
+        std::array<float, 16>& t) {
+      auto fit = LineFit{ quantize(e0), quantize(e1), { }, 0 };
+      auto palette = std::vector<Color>(weights.size());
+      for (auto w = 0u; w < weights.size(); ++w)
+        for (auto i = 0u; i < 4; ++i)
+          palette[w][i] = static_cast<float>(
+            ((64 - weights[w]) * static_cast<int>(fit.e0.value[i]) +
+             weights[w] * static_cast<int>(fit.e1.value[i]) + 32) >> 6);
+      for (auto i = 0u; i < 16; ++i) {
+        auto best_distance = std::numeric_limits<float>::max();
+        for (auto w = 0u; w < weights.size(); ++w) {
+          const auto distance = distance_squared(colors[i], palette[w], channels);
+          if (distance < best_distance) {
+            best_distance = distance;
+            fit.indices[i] = w;
+          }
+        }
+        fit.error += best_distance;
+        t[i] = static_cast<float>(weights[fit.indices[i]]) / 64;
+      }
+      return fit;
+    };
+
+    auto t = std::array<float, 16>{ };
+    auto e0 = Color{ }, e1 = Color{ };
+    fit_end_points(colors, 16, channels, e0, e1);
+    auto best = evaluate(e0, e1, t);
+    for (auto iteration = 0; iteration < 2 && best.error > 0; ++iteration) {
+      if (!refine_end_points(colors, t.data(), 16, e0, e1))
+        break;
+      auto next_t = std::array<float, 16>{ };
+      const auto fit = evaluate(e0, e1, next_t);
+      if (fit.error >= best.error)
+        break;
+      best = fit;
+      t = next_t;
+    }
+
+    // the most significant bit of the first index is implicitly 0
+    const auto max_index = static_cast<unsigned>(weights.size() - 1);
+    if (best.indices[0] > max_index / 2) {
+      std::swap(best.e0, best.e1);
+      for (auto& index : best.indices)
+        index = max_index - index;
+    }
+    return best;
+  }
+
+  unsigned quantize_bits(float value, int bits) {
+    const auto max = (1 << bits) - 1;
+    return static_cast<unsigned>(std::clamp(static_cast<int>(
+      std::lround(value * static_cast<float>(max) / 255.0f)), 0, max));
+  }
+
+  // 7 bits per channel and a shared lowest bit
+  EndPoint quantize_mode6(const Color& color) {
+    auto best = EndPoint{ };
+    auto best_error = std::numeric_limits<float>::max();
+    for (auto p = 0u; p < 2; ++p) {
+      auto end_point = EndPoint{ { }, p, { } };
+      auto error = 0.0f;
+      for (auto i = 0u; i < 4; ++i) {
+        end_point.bits[i] = static_cast<unsigned>(std::clamp(
+          std::lround((color[i] - static_cast<float>(p)) / 2), 0l, 127l));
+        end_point.value[i] = static_cast<float>((end_point.bits[i] << 1) | p);
+        error += (end_point.value[i] - color[i]) * (end_point.value[i] - color[i]);
+      }
+      if (error < best_error) {
+        best_error = error;
+        best = end_point;
+      }
+    }
+    return best;
+  }
+
+  // 7 bits per color channel, 8 bits alpha
+  EndPoint quantize_mode5_color(const Color& color) {
+    auto end_point = EndPoint{ };
+    for (auto i = 0u; i < 3; ++i) {
+      end_point.bits[i] = quantize_bits(color[i], 7);
+      end_point.value[i] = static_cast<float>(
+        (end_point.bits[i] << 1) | (end_point.bits[i] >> 6));
+    }
+    return end_point;
+  }
+
+  EndPoint quantize_mode5_alpha(const Color& color) {
+    auto end_point = EndPoint{ };
+    end_point.bits[0] = quantize_bits(color[0], 8);
+    end_point.value[0] = static_cast<float>(end_point.bits[0]);
+    return end_point;
+  }
+
+  // https://learn.microsoft.com/en-us/windows/win32/direct3d11/bc7-format-mode-reference
+  // chooses between mode 6 (RGBA with 4 bit indices) and mode 5
+  // (separate 2 bit indices for color and alpha)
+  void encode_bc7_modes_5_6(const RGBA* pixels, uint8_t* out) {
+    // the color of fully transparent pixels does not matter,
+    // set it to the mean of the others, so it does not affect the fit
+    auto colors = std::array<Color, 16>{ };
+    auto alphas = std::array<Color, 16>{ };
+    auto mean = Color{ };
+    auto opaque_count = 0;
+    for (auto i = 0u; i < 16; ++i) {
+      colors[i] = to_color(pixels[i]);
+      alphas[i][0] = colors[i][3];
+      if (pixels[i].a) {
+        for (auto j = 0u; j < 3; ++j)
+          mean[j] += colors[i][j];
+        ++opaque_count;
+      }
+    }
+    for (auto i = 0u; i < 16; ++i)
+      if (!pixels[i].a)
+        for (auto j = 0u; j < 3; ++j)
+          colors[i][j] = (opaque_count ?
+            std::round(mean[j] / static_cast<float>(opaque_count)) : 0);
+
+    static const auto weights_2 = std::vector<int>{ 0, 21, 43, 64 };
+    static const auto weights_4 = std::vector<int>{
+      0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    const auto mode6 = fit_line(colors.data(), 4, weights_4, quantize_mode6);
+    const auto mode5_color = fit_line(colors.data(), 3, weights_2, quantize_mode5_color);
+    const auto mode5_alpha = fit_line(alphas.data(), 1, weights_2, quantize_mode5_alpha);
+
+    auto writer = BitWriter(out);
+    if (mode6.error <= mode5_color.error + mode5_alpha.error) {
+      writer.put(1u << 6, 7);
+      for (auto i = 0u; i < 4; ++i) {
+        writer.put(mode6.e0.bits[i], 7);
+        writer.put(mode6.e1.bits[i], 7);
+      }
+      writer.put(mode6.e0.p_bit, 1);
+      writer.put(mode6.e1.p_bit, 1);
+      writer.put(mode6.indices[0], 3);
+      for (auto i = 1u; i < 16; ++i)
+        writer.put(mode6.indices[i], 4);
+    }
+    else {
+      writer.put(1u << 5, 6);
+      writer.put(0, 2); // no channel rotation
+      for (auto i = 0u; i < 3; ++i) {
+        writer.put(mode5_color.e0.bits[i], 7);
+        writer.put(mode5_color.e1.bits[i], 7);
+      }
+      writer.put(mode5_alpha.e0.bits[0], 8);
+      writer.put(mode5_alpha.e1.bits[0], 8);
+      for (const auto& fit : { mode5_color, mode5_alpha }) {
+        writer.put(fit.indices[0], 1);
+        for (auto i = 1u; i < 16; ++i)
+          writer.put(fit.indices[i], 2);
+      }
+    }
+  }
+
+  // https://registry.khronos.org/DataFormat/specs/1.3/dataformat.1.3.html#ETC2
+  const auto etc_modifiers = std::array<std::array<int, 2>, 8>{ {
+    { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 },
+    { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 } } };
+
+  const auto eac_modifiers = std::array<std::array<int, 8>, 16>{ {
+    { -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 },
+    { -2, -5, -8, -13, 1, 4, 7, 12 }, { -2, -4, -6, -13, 1, 3, 5, 12 },
+    { -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 },
+    { -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 },
+    { -2, -6, -8, -10, 1, 5, 7, 9 }, { -2, -5, -8, -10, 1, 4, 7, 9 },
+    { -2, -4, -8, -10, 1, 3, 7, 9 }, { -2, -5, -7, -10, 1, 4, 6, 9 },
+    { -3, -4, -7, -10, 2, 3, 6, 9 }, { -1, -2, -3, -10, 0, 1, 2, 9 },
+    { -4, -6, -8, -9, 3, 5, 7, 8 }, { -3, -5, -7, -9, 2, 4, 6, 8 } } };
+
+  // ETC pixel indices run down the columns
+  int get_etc_pixel_index(int pixel) {
+    return (pixel % 4) * 4 + pixel / 4;
+  }
+
+  // two sub blocks of 2x4 pixels, or of 4x2 pixels when flipped
+  std::array<int, 8> get_etc_sub_block(bool flip, int sub_block) {
+    auto pixels = std::array<int, 8>{ };
+    for (auto i = 0; i < 8; ++i) {
+      const auto x = (flip ? i % 4 : i % 2 + sub_block * 2);
+      const auto y = (flip ? i / 4 + sub_block * 2 : i / 2);
+      pixels[static_cast<size_t>(i)] = y * 4 + x;
+    }
+    return pixels;
+  }
+
+  struct EtcSubBlock {
+    unsigned table;
+    uint32_t indices;
+    int error;
+  };
+
+  EtcSubBlock fit_etc_sub_block(const RGBA* pixels,
+      const std::array<int, 8>& sub_block, const std::array<int, 3>& base,
+      bool ignore_transparent) {
+    auto best = EtcSubBlock{ 0, 0, std::numeric_limits<int>::max() };
+    for (auto table = 0u; table < 8; ++table) {
+      auto candidate = EtcSubBlock{ table, 0, 0 };
+      for (auto p : sub_block) {
+        const auto& pixel = pixels[p];
+        if (ignore_transparent && pixel.a == 0)
+          continue;
+        // index bits select the sign and the magnitude of the modifier
+        auto best_index = 0u;
+        auto best_error = std::numeric_limits<int>::max();
+        for (auto index = 0u; index < 4; ++index) {
+          const auto modifier = etc_modifiers[table][index & 1] *
+            (index & 2 ? -1 : 1);
+          auto error = 0;
+          for (auto c = 0; c < 3; ++c) {
+            const auto d = std::clamp(base[static_cast<size_t>(c)] + modifier,
+              0, 255) - pixel.channel(c);
+            error += d * d;
+          }
+          if (error < best_error) {
+            best_error = error;
+            best_index = index;
+          }
+        }
+        const auto index = get_etc_pixel_index(p);
+        candidate.indices |= ((best_index >> 1) << (16 + index)) |
+                             ((best_index & 1) << index);
+        candidate.error += best_error;
+      }
+      if (candidate.error < best.error)
+        best = candidate;
+    }
+    return best;
+  }
+
+  std::array<float, 3> get_etc_average(const RGBA* pixels,
+      const std::array<int, 8>& sub_block, bool ignore_transparent) {
+    auto sum = std::array<float, 3>{ };
+    auto count = 0;
+    for (auto p : sub_block)
+      if (!ignore_transparent || pixels[p].a != 0) {
+        for (auto c = 0; c < 3; ++c)
+          sum[static_cast<size_t>(c)] += pixels[p].channel(c);
+        ++count;
+      }
+    if (count)
+      for (auto& value : sum)
+        value /= static_cast<float>(count);
+    return sum;
+  }
+
+  // only the individual and the differential mode of ETC1 are used,
+  // the differential mode never overflows into the ETC2 T, H or planar mode
+  void encode_etc_color_block(const RGBA* pixels, uint8_t* out, bool ignore_transparent) {
+    const auto quantize = [](float value, int max) {
+      return static_cast<int>(std::lround(value * static_cast<float>(max) / 255.0f));
+    };
+    auto best_error = std::numeric_limits<int>::max();
+    auto best_bits = uint64_t{ };
+    for (auto flip = 0u; flip < 2; ++flip) {
+      const auto sub_block0 = get_etc_sub_block(flip, 0);
+      const auto sub_block1 = get_etc_sub_block(flip, 1);
+      const auto average0 = get_etc_average(pixels, sub_block0, ignore_transparent);
+      const auto average1 = get_etc_average(pixels, sub_block1, ignore_transparent);
+      for (auto differential = 0u; differential < 2; ++differential) {
+        auto q0 = std::array<int, 3>{ }, q1 = std::array<int, 3>{ };
+        auto base0 = std::array<int, 3>{ }, base1 = std::array<int, 3>{ };
+        for (auto c = 0u; c < 3; ++c) {
+          if (differential) {
+            // second color is stored as a delta of -4 to 3
+            q0[c] = quantize(average0[c], 31);
+            q1[c] = q0[c] + std::clamp(quantize(average1[c], 31) - q0[c], -4, 3);
+            base0[c] = (q0[c] << 3) | (q0[c] >> 2);
+            base1[c] = (q1[c] << 3) | (q1[c] >> 2);
+          }
+          else {
+            q0[c] = quantize(average0[c], 15);
+            q1[c] = quantize(average1[c], 15);
+            base0[c] = q0[c] * 17;
+            base1[c] = q1[c] * 17;
+          }
+        }
+        const auto fit0 = fit_etc_sub_block(pixels, sub_block0, base0, ignore_transparent);
+        const auto fit1 = fit_etc_sub_block(pixels, sub_block1, base1, ignore_transparent);
+        if (fit0.error + fit1.error >= best_error)
+          continue;
+        best_error = fit0.error + fit1.error;
+
+        auto bits = uint64_t{ };
+        for (auto c = 0u; c < 3; ++c) {
+          const auto shift = 56 - c * 8;
+          if (differential) {
+            bits |= uint64_t{ to_unsigned(q0[c]) } << (shift + 3);
+            bits |= uint64_t{ to_unsigned(q1[c] - q0[c]) & 7u } << shift;
+          }
+          else {
+            bits |= uint64_t{ to_unsigned(q0[c]) } << (shift + 4);
+            bits |= uint64_t{ to_unsigned(q1[c]) } << shift;
+          }
+        }
+        bits |= uint64_t{ fit0.table } << 37;
+        bits |= uint64_t{ fit1.table } << 34;
+        bits |= uint64_t{ differential } << 33;
+        bits |= uint64_t{ flip } << 32;
+        bits |= uint64_t{ fit0.indices | fit1.indices };
+        best_bits = bits;
+      }
+    }
+    for (auto i = 0; i < 8; ++i)
+      out[i] = static_cast<uint8_t>(best_bits >> (56 - i * 8));
+  }
+
+  void encode_eac_alpha_block(const RGBA* pixels, uint8_t* out) {
+    auto min = 255, max = 0;
+    for (auto i = 0; i < 16; ++i) {
+      min = std::min(min, int{ pixels[i].a });
+      max = std::max(max, int{ pixels[i].a });
+    }
+
+    auto best_error = std::numeric_limits<int>::max();
+    auto best_bits = uint64_t{ };
+    for (auto table = 0u; table < 16; ++table) {
+      const auto& modifiers = eac_modifiers[table];
+      const auto range = modifiers[7] - modifiers[3];
+      // only multipliers close to the one spanning the alpha range
+      const auto spanning = (max - min + range / 2) / range;
+      for (auto multiplier = std::max(spanning - 1, 1);
+           multiplier <= std::min(spanning + 1, 15); ++multiplier) {
+        const auto base = std::clamp((min + max -
+          (modifiers[7] + modifiers[3]) * multiplier + 1) / 2, 0, 255);
+        auto error = 0;
+        auto indices = uint64_t{ };
+        for (auto i = 0; i < 16; ++i) {
+          auto best_index = 0u;
+          auto best_distance = std::numeric_limits<int>::max();
+          for (auto index = 0u; index < 8; ++index) {
+            const auto value = std::clamp(base + modifiers[index] * multiplier, 0, 255);
+            const auto distance = std::abs(value - pixels[i].a);
+            if (distance < best_distance) {
+              best_distance = distance;
+              best_index = index;
+            }
+          }
+          error += best_distance * best_distance;
+          indices |= uint64_t{ best_index } << (45 - get_etc_pixel_index(i) * 3);
+        }
+        if (error < best_error) {
+          best_error = error;
+          best_bits = (uint64_t{ to_unsigned(base) } << 56) |
+            (uint64_t{ to_unsigned(multiplier) } << 52) |
+            (uint64_t{ table } << 48) | indices;
+        }
+      }
+    }
+    for (auto i = 0; i < 8; ++i)
+      out[i] = static_cast<uint8_t>(best_bits >> (56 - i * 8));
+  }
+
+  using EncodeBlock = void(*)(const RGBA*, uint8_t*);
+
+  EncodeBlock get_block_encoder(TextureEncoding encoding) {
+    switch (encoding) {
+      case TextureEncoding::uncompressed: break;
+      case TextureEncoding::bc1: return encode_bc1_block;
+      case TextureEncoding::bc3: return encode_bc3_block;
+      case TextureEncoding::bc7: return encode_bc7_block;
+      case TextureEncoding::etc2: return encode_etc2_block;
+      case TextureEncoding::etc2_eac: return encode_etc2_eac_block;
+    }
+    return nullptr;
+  }
+
+  // rows of blocks are encoded in parallel
+  Buffer encode_level(const Image& image, TextureEncoding encoding) {
+    const auto width = image.width();
+    const auto height = image.height();
+    const auto block_size = get_block_size(encoding);
+    if (!block_size) {
+      const auto size = to_unsigned(width * height) * sizeof(RGBA);
+      const auto begin = reinterpret_cast<const uint8_t*>(image.rgba());
+      return Buffer(begin, begin + size);
+    }
+
+    const auto encode_block = get_block_encoder(encoding);
+    const auto blocks_x = (width + 3) / 4;
+    const auto blocks_y = (height + 3) / 4;
+    const auto row_size = to_unsigned(blocks_x * block_size);
+    auto buffer = Buffer(row_size * to_unsigned(blocks_y));
+    scheduler.for_each_parallel([&](size_t block_y) {
+      auto pixels = std::array<RGBA, 16>{ };
+      auto out = buffer.data() + block_y * row_size;
+      for (auto block_x = 0; block_x < blocks_x; ++block_x) {
+        // partial blocks repeat the edge pixels
+        for (auto y = 0; y < 4; ++y)
+          for (auto x = 0; x < 4; ++x)
+            pixels[to_unsigned(y * 4 + x)] = image.rgba_at({
+              std::min(block_x * 4 + x, width - 1),
+              std::min(to_int(block_y) * 4 + y, height - 1) });
+        encode_block(pixels.data(), out);
+        out += block_size;
+      }
+    }, static_cast<size_t>(blocks_y));
+    return buffer;
+  }
+
+  struct Ktx2Format {
+    struct Sample { uint32_t bit_offset, bit_length, channel, upper; };
+    uint32_t vk_format;
+    uint32_t color_model;
+    std::vector<Sample> samples;
+  };
+
+  enum : uint32_t {
+    VK_FORMAT_R8G8B8A8_SRGB = 43, VK_FORMAT_BC1_RGBA_SRGB_BLOCK = 134,
+    VK_FORMAT_BC3_SRGB_BLOCK = 138, VK_FORMAT_BC7_SRGB_BLOCK = 146,
+    VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK = 148, VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK = 152,
+    KHR_DF_MODEL_RGBSDA = 1, KHR_DF_MODEL_BC1A = 128, KHR_DF_MODEL_BC3 = 130,
+    KHR_DF_MODEL_BC7 = 134, KHR_DF_MODEL_ETC2 = 161,
+    KHR_DF_CHANNEL_ETC2_COLOR = 2, KHR_DF_CHANNEL_ETC2_ALPHA = 15,
+    KHR_DF_PRIMARIES_BT709 = 1, KHR_DF_TRANSFER_SRGB = 2,
+    KHR_DF_FLAG_ALPHA_PREMULTIPLIED = 1, KHR_DF_SAMPLE_DATATYPE_LINEAR = 0x10,
+  };
+
+  // the color is sRGB encoded, alpha is linear
+  Ktx2Format get_ktx2_format(TextureEncoding encoding) {
+    const auto all = ~uint32_t{ };
+    const auto alpha = 15 | KHR_DF_SAMPLE_DATATYPE_LINEAR;
+    switch (encoding) {
+      case TextureEncoding::uncompressed: break;
+      case TextureEncoding::bc1:
+        return { VK_FORMAT_BC1_RGBA_SRGB_BLOCK, KHR_DF_MODEL_BC1A,
+          { { 0, 64, 1, all } } };
+      case TextureEncoding::bc3:
+        return { VK_FORMAT_BC3_SRGB_BLOCK, KHR_DF_MODEL_BC3,
+          { { 0, 64, alpha, all }, { 64, 64, 0, all } } };
+      case TextureEncoding::bc7:
+        return { VK_FORMAT_BC7_SRGB_BLOCK, KHR_DF_MODEL_BC7,
+          { { 0, 128, 0, all } } };
+      case TextureEncoding::etc2:
+        return { VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK, KHR_DF_MODEL_ETC2,
+          { { 0, 64, KHR_DF_CHANNEL_ETC2_COLOR, all } } };
+      case TextureEncoding::etc2_eac:
+        return { VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK, KHR_DF_MODEL_ETC2,
+          { { 0, 64, KHR_DF_CHANNEL_ETC2_ALPHA | KHR_DF_SAMPLE_DATATYPE_LINEAR, all },
+            { 64, 64, KHR_DF_CHANNEL_ETC2_COLOR, all } } };
+    }
+    return { VK_FORMAT_R8G8B8A8_SRGB, KHR_DF_MODEL_RGBSDA,
+      { { 0, 8, 0, 255 }, { 8, 8, 1, 255 }, { 16, 8, 2, 255 }, { 24, 8, alpha, 255 } } };
+  }
+
+  bool write_file(const std::filesystem::path& filename, const Buffer& header,
+      const std::vector<Buffer>& levels) {
+    const auto file = open_file(filename);
+    if (!file || std::fwrite(header.data(), header.size(), 1, file.get()) != 1)
+      return false;
+    for (const auto& level : levels)
+      if (!level.empty() &&
+          std::fwrite(level.data(), level.size(), 1, file.get()) != 1)
+        return false;
+    return true;
+  }
+} // namespace
+
+void encode_bc1_block(const RGBA* pixels, uint8_t* out) {
+  encode_color_block(pixels, out, true);
+}
+
+void encode_bc3_block(const RGBA* pixels, uint8_t* out) {
+  encode_alpha_block(pixels, out);
+  encode_color_block(pixels, out + 8, false);
+}
+
+void encode_bc7_block(const RGBA* pixels, uint8_t* out) {
+  encode_bc7_modes_5_6(pixels, out);
+}
+
+void encode_etc2_block(const RGBA* pixels, uint8_t* out) {
+  encode_etc_color_block(pixels, out, false);
+}
+
+void encode_etc2_eac_block(const RGBA* pixels, uint8_t* out) {
+  encode_eac_alpha_block(pixels, out);
+  encode_etc_color_block(pixels, out + 8, true);
+}
+
+// https://learn.microsoft.com/en-us/windows/win32/direct3ddds/dds-header
+bool write_dds(const std::vector<Image>& levels,
+    const std::filesystem::path& filename, TextureEncoding encoding,
+    bool premultiplied) {
+  // there is no ETC2 format
+  if (levels.empty() || is_etc2(encoding))
+    return false;
+  const auto width = static_cast<uint32_t>(levels[0].width());
+  const auto height = static_cast<uint32_t>(levels[0].height());
+  const auto level_count = static_cast<uint32_t>(levels.size());
+  const auto block_size = static_cast<uint32_t>(get_block_size(encoding));
+
+  auto encoded = std::vector<Buffer>();
+  for (const auto& level : levels)
+    encoded.push_back(encode_level(level, encoding));
+
+  enum : uint32_t {
+    DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PITCH = 0x8,
+    DDSD_PIXELFORMAT = 0x1000, DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000,
+    DDPF_FOURCC = 0x4,
+    DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000,
+    DXGI_FORMAT_R8G8B8A8_UNORM_SRGB = 29, DXGI_FORMAT_BC1_UNORM_SRGB = 72,
+    DXGI_FORMAT_BC3_UNORM_SRGB = 78, DXGI_FORMAT_BC7_UNORM_SRGB = 99,
+    D3D10_RESOURCE_DIMENSION_TEXTURE2D = 3,
+    DDS_ALPHA_MODE_STRAIGHT = 1, DDS_ALPHA_MODE_PREMULTIPLIED = 2,
+  };
+  const auto four_cc = [](const char* code) {
+    return static_cast<uint32_t>(code[0]) | (static_cast<uint32_t>(code[1]) << 8) |
+      (static_cast<uint32_t>(code[2]) << 16) | (static_cast<uint32_t>(code[3]) << 24);
+  };
+
+  auto header = Buffer();
+  put_le(header, four_cc("DDS "));
+  put_le(header, uint32_t{ 124 });
+  put_le(header, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT |
+    (level_count > 1 ? uint32_t{ DDSD_MIPMAPCOUNT } : 0u) |
+    (block_size ? DDSD_LINEARSIZE : DDSD_PITCH));
+  put_le(header, height);
+  put_le(header, width);
+  put_le(header, static_cast<uint32_t>(block_size ? encoded[0].size() : width * 4));
+  put_le(header, uint32_t{ }); // depth
+  put_le(header, level_count);
+  for (auto i = 0; i < 11; ++i)
+    put_le(header, uint32_t{ });
+
+  // pixel format, only the DX10 header can declare sRGB and the alpha mode
+  put_le(header, uint32_t{ 32 });
+  put_le(header, uint32_t{ DDPF_FOURCC });
+  put_le(header, four_cc("DX10"));
+  for (auto i = 0; i < 5; ++i)
+    put_le(header, uint32_t{ });
+  put_le(header, DDSCAPS_TEXTURE |
+    (level_count > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0));
+  for (auto i = 0; i < 4; ++i)
+    put_le(header, uint32_t{ });
+
+  put_le(header, uint32_t{
+    encoding == TextureEncoding::bc1 ? DXGI_FORMAT_BC1_UNORM_SRGB :
+    encoding == TextureEncoding::bc3 ? DXGI_FORMAT_BC3_UNORM_SRGB :
+    encoding == TextureEncoding::bc7 ? DXGI_FORMAT_BC7_UNORM_SRGB :
+                                       DXGI_FORMAT_R8G8B8A8_UNORM_SRGB });
+  put_le(header, uint32_t{ D3D10_RESOURCE_DIMENSION_TEXTURE2D });
+  put_le(header, uint32_t{ }); // misc flags
+  put_le(header, uint32_t{ 1 }); // array size
+  put_le(header, uint32_t{ premultiplied ?
+    DDS_ALPHA_MODE_PREMULTIPLIED : DDS_ALPHA_MODE_STRAIGHT }); // misc flags 2
+  return write_file(filename, header, encoded);
+}
+
+// https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+bool write_ktx2(const std::vector<Image>& levels,
+    const std::filesystem::path& filename, TextureEncoding encoding,
+    bool premultiplied) {
+  if (levels.empty())
+    return false;
+  const auto level_count = levels.size();
+  const auto block_size = static_cast<uint32_t>(get_block_size(encoding));
+
+  auto encoded = std::vector<Buffer>();
+  for (const auto& level : levels)
+    encoded.push_back(encode_level(level, encoding));
+
+  // data format descriptor with a single basic block
+  const auto format = get_ktx2_format(encoding);
+  const auto& samples = format.samples;
+
+  auto dfd = Buffer();
+  const auto block_length = static_cast<uint32_t>(24 + 16 * samples.size());
+  put_le(dfd, 4 + block_length);
+  put_le(dfd, uint32_t{ }); // vendor and descriptor type
+  put_le(dfd, 2 | (block_length << 16)); // version
+  put_le(dfd, format.color_model | (KHR_DF_PRIMARIES_BT709 << 8) |
+    (KHR_DF_TRANSFER_SRGB << 16) |
+    ((premultiplied ? KHR_DF_FLAG_ALPHA_PREMULTIPLIED : 0u) << 24));
+  put_le(dfd, block_size ? uint32_t{ 0x00000303 } : uint32_t{ });
+  put_le(dfd, block_size ? block_size : uint32_t{ 4 }); // bytes plane 0
+  put_le(dfd, uint32_t{ });
+  for (const auto& sample : samples) {
+    put_le(dfd, sample.bit_offset | ((sample.bit_length - 1) << 16) |
+      (sample.channel << 24));
+    put_le(dfd, uint32_t{ }); // sample position
+    put_le(dfd, uint32_t{ }); // lower
+    put_le(dfd, sample.upper);
+  }
+
+  // levels are stored from smallest to largest, aligned to the block size
+  const auto header_size = size_t{ 80 + 24 * level_count };
+  const auto alignment = size_t{ block_size ? block_size : 4 };
+  const auto align = [&](size_t offset) {
+    return (offset + alignment - 1) / alignment * alignment;
+  };
+  auto offsets = std::vector<size_t>(level_count);
+  auto offset = header_size + dfd.size();
+  auto ordered = std::vector<Buffer>();
+  for (auto i = level_count; i-- > 0; ) {
+    const auto aligned = align(offset);
+    ordered.push_back(Buffer(aligned - offset));
+    offsets[i] = aligned;
+    offset = aligned + encoded[i].size();
+    ordered.push_back(std::move(encoded[i]));
+  }
+
+  auto header = Buffer{ 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+  put_le(header, format.vk_format);
+  put_le(header, uint32_t{ 1 }); // type size
+  put_le(header, static_cast<uint32_t>(levels[0].width()));
+  put_le(header, static_cast<uint32_t>(levels[0].height()));
+  put_le(header, uint32_t{ }); // depth
+  put_le(header, uint32_t{ }); // layer count
+  put_le(header, uint32_t{ 1 }); // face count
+  put_le(header, static_cast<uint32_t>(level_count));
+  put_le(header, uint32_t{ }); // supercompression scheme
+  put_le(header, static_cast<uint32_t>(header_size));
+  put_le(header, static_cast<uint32_t>(dfd.size()));
+  put_le(header, uint32_t{ }); // key/value data
+  put_le(header, uint32_t{ });
+  put_le(header, uint64_t{ }); // supercompression global data
+  put_le(header, uint64_t{ });
+  for (auto i = 0u; i < level_count; ++i) {
+    const auto size = ordered[2 * (level_count - 1 - i) + 1].size();
+    put_le(header, static_cast<uint64_t>(offsets[i]));
+    put_le(header, static_cast<uint64_t>(size));
+    put_le(header, static_cast<uint64_t>(size));
+  }
+  header.insert(header.end(), dfd.begin(), dfd.end());
+  return write_file(filename, header, ordered);
+}
+
+} // namespace
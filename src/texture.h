@@ -0,0 +1,22 @@
+#pragma once
+
+#include "image.h"
+
+namespace spright {
+
+// the levels are written as sRGB encoded color
+bool write_dds(const std::vector<Image>& levels,
+  const std::filesystem::path& filename, TextureEncoding encoding,
+  bool premultiplied);
+bool write_ktx2(const std::vector<Image>& levels,
+  const std::filesystem::path& filename, TextureEncoding encoding,
+  bool premultiplied);
+
+// encodes a block of 4x4 pixels
+void encode_bc1_block(const RGBA* pixels, uint8_t* out);
+void encode_bc3_block(const RGBA* pixels, uint8_t* out);
+void encode_bc7_block(const RGBA* pixels, uint8_t* out);
+void encode_etc2_block(const RGBA* pixels, uint8_t* out);
+void encode_etc2_eac_block(const RGBA* pixels, uint8_t* out);
+
+} // namespace
@@ -1,5 +1,6 @@
 
 #include "trimming.h"
+#include "nlohmann/json.hpp"
 #include "chipmunk/chipmunk.h"
 extern "C" {
 #include "chipmunk/cpPolyline.h"
@@ -133,6 +134,78 @@ namespace {
     return vertices;
   }
 
+  const auto trim_cache_version = 1;
+
+  struct TrimCacheEntry {
+    Rect trimmed_source_rect;
+    std::vector<PointF> vertices;
+  };
+  using TrimCache = std::map<std::string, TrimCacheEntry, std::less<>>;
+
+  std::string get_cache_key(const Sprite& sprite, const std::string& source_stamp) {
+    const auto& r = sprite.source_rect;
+    auto ss = std::ostringstream();
+    ss << source_stamp << "|" << r.x << "," << r.y << "," << r.w << "," << r.h <<
+      "|" << to_int(sprite.trim) << "," << sprite.trim_margin << "," << 
+      sprite.trim_threshold << "," << sprite.trim_gray_levels;
+    return ss.str();
+  }
+
+  TrimCache read_trim_cache(const std::filesystem::path& filename) {
+    auto cache = TrimCache();
+    auto error = std::error_code{ };
+    if (!std::filesystem::exists(filename, error))
+      return cache;
+    try {
+      const auto json = nlohmann::json::parse(read_textfile(filename));
+      if (json.value("version", 0) != trim_cache_version)
+        return cache;
+      for (const auto& [key, value] : json.at("sprites").items()) {
+        auto& entry = cache[key];
+        const auto& rect = value.at("rect");
+        entry.trimmed_source_rect = {
+          rect.at(0).get<int>(), rect.at(1).get<int>(),
+          rect.at(2).get<int>(), rect.at(3).get<int>()
+        };
+        const auto& vertices = value.at("vertices");
+        for (auto i = size_t{ }; i + 1 < vertices.size(); i += 2)
+          entry.vertices.push_back({
+            vertices[i].get<real>(), vertices[i + 1].get<real>()
+          });
+      }
+    }
+    catch (const std::exception&) {
+      // simply ignore invalid cache
+      cache.clear();
+    }
+    return cache;
+  }
+
+  void write_trim_cache(const std::filesystem::path& filename, 
+      const std::vector<Sprite>& sprites, 
+      const std::vector<std::string>& cache_keys) {
+    auto json = nlohmann::json::object();
+    json["version"] = trim_cache_version;
+    auto& json_sprites = json["sprites"];
+    json_sprites = nlohmann::json::object();
+    for (auto i = size_t{ }; i < sprites.size(); ++i) {
+      if (cache_keys[i].empty())
+        continue;
+      const auto& sprite = sprites[i];
+      const auto& rect = sprite.trimmed_source_rect;
+      auto vertices = nlohmann::json::array();
+      for (const auto& vertex : sprite.vertices) {
+        vertices.push_back(vertex.x);
+        vertices.push_back(vertex.y);
+      }
+      json_sprites[cache_keys[i]] = {
+        { "rect", { rect.x, rect.y, rect.w, rect.h } },
+        { "vertices", std::move(vertices) },
+      };
+    }
+    update_textfile(filename, json.dump());
+  }
+
   void trim_sprite(Sprite& sprite) {
     
     if (sprite.trim != Trim::none) {
@@ -169,8 +242,61 @@ namespace {
   }
 } // namespace
 
-void trim_sprites(std::vector<Sprite>& sprites) {
-  scheduler.for_each_parallel(sprites, trim_sprite);
+int trim_sprites(std::vector<Sprite>& sprites, 
+    const std::filesystem::path& cache_filename, bool read_cache) {
+  if (cache_filename.empty()) {
+    auto sources = std::vector<ImagePtr>();
+    for (const auto& sprite : sprites)
+      if (sprite.trim != Trim::none)
+        sources.push_back(sprite.source);
+    prefetch_pixels(sources);
+    scheduler.for_each_parallel(sprites, trim_sprite);
+    return 0;
+  }
+
+  // only cache sprites which are actually trimmed
+  auto source_stamps = std::map<const Image*, std::string>();
+  auto cache_keys = std::vector<std::string>(sprites.size());
+  for (auto i = size_t{ }; i < sprites.size(); ++i) {
+    const auto& sprite = sprites[i];
+    if (sprite.trim == Trim::none)
+      continue;
+    auto it = source_stamps.find(sprite.source.get());
+    if (it == source_stamps.end())
+      it = source_stamps.emplace(sprite.source.get(),
+        get_source_stamp(*sprite.source)).first;
+    if (!it->second.empty())
+      cache_keys[i] = get_cache_key(sprite, it->second);
+  }
+
+  const auto cache = (read_cache ? 
+    read_trim_cache(cache_filename) : TrimCache());
+  auto sources = std::vector<ImagePtr>();
+  for (auto i = size_t{ }; i < sprites.size(); ++i)
+    if (sprites[i].trim != Trim::none &&
+        (cache_keys[i].empty() || !cache.count(cache_keys[i])))
+      sources.push_back(sprites[i].source);
+  prefetch_pixels(sources);
+
+  auto cached_sprites = std::atomic<int>{ };
+  scheduler.for_each_parallel(
+    [&](size_t index) {
+      auto& sprite = sprites[index];
+      const auto& key = cache_keys[index];
+      if (!key.empty())
+        if (auto it = cache.find(key); it != cache.end()) {
+          sprite.trimmed_source_rect = it->second.trimmed_source_rect;
+          sprite.vertices = it->second.vertices;
+          ++cached_sprites;
+          return;
+        }
+      trim_sprite(sprite);
+    }, sprites.size());
+
+  if (std::any_of(cache_keys.begin(), cache_keys.end(),
+        [](const std::string& key) { return !key.empty(); }))
+    write_trim_cache(cache_filename, sprites, cache_keys);
+  return cached_sprites.load();
 }
 
 } // namespace
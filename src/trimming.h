@@ -4,6 +4,8 @@
 
 namespace spright {
 
-void trim_sprites(std::vector<Sprite>& sprites);
+// returns the number of sprites, which were restored from the cache
+int trim_sprites(std::vector<Sprite>& sprites, 
+  const std::filesystem::path& cache_filename = { }, bool read_cache = true);
 
 } // namespace
@@ -1,7 +1,9 @@
 
 #include "catch.hpp"
 #include "src/common.h"
+#include "src/settings.h"
 #include <sstream>
+#include <list>
 
 using namespace spright;
 
@@ -103,6 +105,91 @@ TEST_CASE("split_arguments - optional comma") {
   
 }
 
+TEST_CASE("interpret_commandline - threads and affinity") {
+  const auto interpret = [](std::vector<const char*> arguments, Settings& settings) {
+    arguments.insert(arguments.begin(), "spright");
+    return interpret_commandline(settings, static_cast<int>(arguments.size()),
+      arguments.data());
+  };
+
+  auto settings = Settings{ };
+  CHECK(interpret({ "--threads", "4" }, settings));
+  CHECK(settings.threads == 4);
+  CHECK(interpret({ "--affinity", "0x0F" }, settings));
+  CHECK(settings.affinity_mask == 0x0F);
+  CHECK(interpret({ "--affinity", "12" }, settings));
+  CHECK(settings.affinity_mask == 12);
+
+  // malformed values are rejected and do not change the settings
+  for (const auto value : { "", "0", "-2", "4x", "2abc", " ", "99999999999" }) {
+    CHECK(!interpret({ "--threads", value }, settings));
+    CHECK(settings.threads == 4);
+  }
+  for (const auto value : { "", "0", "0x", "0xFG", "12a" }) {
+    CHECK(!interpret({ "--affinity", value }, settings));
+    CHECK(settings.affinity_mask == 12);
+  }
+  CHECK(!interpret({ "--threads" }, settings));
+  CHECK(!interpret({ "--affinity" }, settings));
+}
+
+TEST_CASE("Scheduler - for_each_parallel over list") {
+  for (const auto count : { 0, 1, 7, 1000 }) {
+    auto items = std::list<std::atomic<int>>(static_cast<size_t>(count));
+    scheduler.for_each_parallel(items, [](std::atomic<int>& item) { ++item; });
+    CHECK(std::all_of(items.begin(), items.end(), 
+      [](const std::atomic<int>& item) { return item == 1; }));
+  }
+}
+
+TEST_CASE("Scheduler - nested for_each_parallel") {
+  scheduler.configure(4);
+
+  // every index of the inner loops runs exactly once
+  const auto outer = size_t{ 16 };
+  const auto inner = size_t{ 100 };
+  const auto run_nested = [&](std::vector<std::atomic<int>>& counts) {
+    scheduler.for_each_parallel([&](size_t i) {
+      scheduler.for_each_parallel([&](size_t j) {
+        ++counts[i * inner + j];
+      }, inner);
+    }, outer);
+  };
+  const auto all_once = [](const std::vector<std::atomic<int>>& counts) {
+    return std::all_of(counts.begin(), counts.end(),
+      [](const std::atomic<int>& count) { return count == 1; });
+  };
+  auto counts = std::vector<std::atomic<int>>(outer * inner);
+  run_nested(counts);
+  CHECK(all_once(counts));
+
+  // nested within an asynchronous task
+  auto async_counts = std::vector<std::atomic<int>>(outer * inner);
+  auto done = std::atomic<bool>{ };
+  scheduler.async([&]() {
+    run_nested(async_counts);
+    done = true;
+  });
+  while (!done)
+    std::this_thread::yield();
+  CHECK(all_once(async_counts));
+
+  // exception thrown by a helper is rethrown to the caller,
+  // the caller waits until a helper executed an index
+  const auto caller = std::this_thread::get_id();
+  auto helped = std::atomic<bool>{ };
+  CHECK_THROWS_AS(scheduler.for_each_parallel([&](size_t) {
+    if (std::this_thread::get_id() != caller) {
+      helped = true;
+      throw std::runtime_error("helper failed");
+    }
+    while (!helped)
+      std::this_thread::yield();
+  }, size_t{ 64 }), std::runtime_error);
+
+  scheduler.configure(0);
+}
+
 TEST_CASE("Rect") {
   CHECK(combine(Rect(0, 0, 4, 4), Rect(4, 0, 4, 4)) == Rect(0, 0, 8, 4));
 }
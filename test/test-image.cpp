@@ -0,0 +1,796 @@
+
+#include "catch.hpp"
+#include "src/image.h"
+#include "src/png.h"
+#include "src/texture.h"
+#include <fstream>
+
+using namespace spright;
+
+namespace {
+  Image get_test_image(int width, int height) {
+    auto image = Image(width, height);
+    for (auto y = 0; y < height; ++y)
+      for (auto x = 0; x < width; ++x)
+        image.rgba_at({ x, y }) = RGBA{ {
+          to_byte(x * 7), to_byte(y * 3), to_byte((x ^ y) & 0xFF),
+          to_byte(x < width / 2 ? 255 : (x + y) % 256) } };
+    return image;
+  }
+
+  // http://paulbourke.net/geometry/polygonmesh/
+  bool point_in_polygon(real x, real y, const std::vector<PointF>& p) {
+    auto c = false;
+    for (auto i = size_t{ }, j = p.size() - 1; i < p.size(); j = i++)
+      if ((((p[i].y <= y) && (y < p[j].y)) ||
+           ((p[j].y <= y) && (y < p[i].y))) &&
+          (x < (p[j].x - p[i].x) * (y - p[i].y) / (p[j].y - p[i].y) + p[i].x))
+        c = !c;
+    return c;
+  }
+
+  // https://learn.microsoft.com/en-us/windows/win32/direct3d10/d3d10-graphics-programming-guide-resources-block-compression
+  std::array<RGBA, 16> decode_bc1_block(const uint8_t* block) {
+    const auto expand = [](int value) {
+      const auto r = (value >> 11) & 31, g = (value >> 5) & 63, b = value & 31;
+      return std::array<int, 4>{ (r << 3) | (r >> 2), (g << 2) | (g >> 4),
+                                 (b << 3) | (b >> 2), 255 };
+    };
+    const auto c0 = block[0] | (block[1] << 8);
+    const auto c1 = block[2] | (block[3] << 8);
+    auto palette = std::array<std::array<int, 4>, 4>{ expand(c0), expand(c1) };
+    for (auto i = 0u; i < 4; ++i) {
+      const auto a = palette[0][i], b = palette[1][i];
+      palette[2][i] = (c0 > c1 ? (2 * a + b) / 3 : (a + b) / 2);
+      palette[3][i] = (c0 > c1 ? (a + 2 * b) / 3 : 0);
+    }
+    auto pixels = std::array<RGBA, 16>{ };
+    for (auto i = 0; i < 16; ++i) {
+      const auto& color = palette[(block[4 + i / 4] >> (i % 4 * 2)) & 3];
+      pixels[static_cast<size_t>(i)] = RGBA{ { to_byte(color[0]), 
+        to_byte(color[1]), to_byte(color[2]), to_byte(color[3]) } };
+    }
+    return pixels;
+  }
+
+  // https://registry.khronos.org/DataFormat/specs/1.3/dataformat.1.3.html#ETC2
+  // only the individual and the differential mode are decoded
+  std::array<RGBA, 16> decode_etc2_block(const uint8_t* block) {
+    auto bits = uint64_t{ };
+    for (auto i = 0; i < 8; ++i)
+      bits = (bits << 8) | block[i];
+    const auto get = [&](int first, int count) {
+      return static_cast<int>((bits >> first) & ((1u << count) - 1));
+    };
+    const auto differential = get(33, 1);
+    const auto flip = get(32, 1);
+    auto base = std::array<std::array<int, 3>, 2>{ };
+    for (auto c = 0; c < 3; ++c) {
+      if (differential) {
+        const auto b0 = get(59 - c * 8, 5);
+        const auto delta = get(56 - c * 8, 3);
+        const auto b1 = b0 + (delta >= 4 ? delta - 8 : delta);
+        REQUIRE(b1 >= 0);
+        REQUIRE(b1 <= 31);
+        base[0][c] = (b0 << 3) | (b0 >> 2);
+        base[1][c] = (b1 << 3) | (b1 >> 2);
+      }
+      else {
+        base[0][c] = get(60 - c * 8, 4) * 17;
+        base[1][c] = get(56 - c * 8, 4) * 17;
+      }
+    }
+    const int modifiers[8][2] = { { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 },
+      { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 } };
+    const int tables[2] = { get(37, 3), get(34, 3) };
+    auto pixels = std::array<RGBA, 16>{ };
+    for (auto x = 0; x < 4; ++x)
+      for (auto y = 0; y < 4; ++y) {
+        const auto i = x * 4 + y;
+        const auto sub_block = (flip ? y / 2 : x / 2);
+        const auto modifier = modifiers[tables[sub_block]][get(i, 1)] *
+          (get(16 + i, 1) ? -1 : 1);
+        auto& pixel = pixels[static_cast<size_t>(y * 4 + x)];
+        for (auto c = 0; c < 3; ++c)
+          pixel.channel(c) = to_byte(std::clamp(base[sub_block][c] + modifier, 0, 255));
+        pixel.a = 255;
+      }
+    return pixels;
+  }
+
+  void decode_eac_alpha_block(const uint8_t* block, std::array<RGBA, 16>& pixels) {
+    const int modifiers[16][8] = {
+      { -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 },
+      { -2, -5, -8, -13, 1, 4, 7, 12 }, { -2, -4, -6, -13, 1, 3, 5, 12 },
+      { -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 },
+      { -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 },
+      { -2, -6, -8, -10, 1, 5, 7, 9 }, { -2, -5, -8, -10, 1, 4, 7, 9 },
+      { -2, -4, -8, -10, 1, 3, 7, 9 }, { -2, -5, -7, -10, 1, 4, 6, 9 },
+      { -3, -4, -7, -10, 2, 3, 6, 9 }, { -1, -2, -3, -10, 0, 1, 2, 9 },
+      { -4, -6, -8, -9, 3, 5, 7, 8 }, { -3, -5, -7, -9, 2, 4, 6, 8 } };
+    auto bits = uint64_t{ };
+    for (auto i = 2; i < 8; ++i)
+      bits = (bits << 8) | block[i];
+    const auto base = int{ block[0] };
+    const auto multiplier = block[1] >> 4;
+    const auto& table = modifiers[block[1] & 15];
+    for (auto i = 0; i < 16; ++i) {
+      const auto index = (bits >> (45 - 3 * i)) & 7;
+      pixels[static_cast<size_t>(i % 4 * 4 + i / 4)].a = to_byte(
+        std::clamp(base + table[index] * multiplier, 0, 255));
+    }
+  }
+
+  struct GifFrame {
+    Rect rect;
+    Image image;
+  };
+
+  // https://www.w3.org/Graphics/GIF/spec-gif89a.txt
+  // frames are composed on a transparent canvas, disposal 2 clears the rect
+  std::vector<GifFrame> decode_gif(const std::string& data) {
+    const auto byte = [&](size_t i) { 
+      return static_cast<int>(static_cast<uint8_t>(data.at(i))); 
+    };
+    const auto word = [&](size_t i) { return byte(i) | (byte(i + 1) << 8); };
+    const auto read_palette = [&](size_t& pos, int flags) {
+      auto palette = std::vector<RGBA>();
+      if (flags & 0x80)
+        for (auto i = 0; i < 2 << (flags & 0x07); ++i, pos += 3)
+          palette.push_back(RGBA{ { to_byte(byte(pos)), to_byte(byte(pos + 1)), 
+            to_byte(byte(pos + 2)), 255 } });
+      return palette;
+    };
+    const auto read_sub_blocks = [&](size_t& pos) {
+      auto bytes = std::string();
+      for (; byte(pos); pos += to_unsigned(byte(pos)) + 1)
+        bytes += data.substr(pos + 1, to_unsigned(byte(pos)));
+      ++pos;
+      return bytes;
+    };
+    const auto decode_lzw = [](const std::string& bytes, int min_code_size) {
+      const auto clear = 1 << min_code_size;
+      auto table = std::vector<std::string>();
+      auto code_size = 0;
+      const auto reset = [&]() {
+        table.resize(to_unsigned(clear + 2));
+        for (auto i = 0; i < clear; ++i)
+          table[to_unsigned(i)] = std::string(1, static_cast<char>(i));
+        code_size = min_code_size + 1;
+      };
+      reset();
+      auto indices = std::string();
+      auto previous = -1;
+      for (auto bit = size_t{ }; bit + to_unsigned(code_size) <= bytes.size() * 8; ) {
+        auto code = 0;
+        for (auto i = 0; i < code_size; ++i, ++bit)
+          code |= ((static_cast<uint8_t>(bytes[bit / 8]) >> (bit % 8)) & 1) << i;
+        if (code == clear) {
+          reset();
+          previous = -1;
+          continue;
+        }
+        if (code == clear + 1)
+          break;
+        auto entry = std::string();
+        if (to_unsigned(code) < table.size())
+          entry = table[to_unsigned(code)];
+        else if (to_unsigned(code) == table.size() && previous >= 0)
+          entry = table[to_unsigned(previous)] + table[to_unsigned(previous)][0];
+        REQUIRE(!entry.empty());
+        indices += entry;
+        if (previous >= 0 && table.size() < 4096)
+          table.push_back(table[to_unsigned(previous)] + entry[0]);
+        if (table.size() == (1u << code_size) && code_size < 12)
+          ++code_size;
+        previous = code;
+      }
+      return indices;
+    };
+
+    REQUIRE(data.substr(0, 6) == "GIF89a");
+    auto canvas = Image(word(6), word(8), RGBA{ });
+    auto pos = size_t{ 13 };
+    const auto global_palette = read_palette(pos, byte(10));
+    auto frames = std::vector<GifFrame>();
+    auto disposal = 0, transparent_index = -1;
+    while (byte(pos) != 0x3B) {
+      if (byte(pos) == 0x21) {
+        const auto label = byte(pos + 1);
+        pos += 2;
+        const auto bytes = read_sub_blocks(pos);
+        if (label == 0xF9) {
+          const auto flags = static_cast<uint8_t>(bytes.at(0));
+          disposal = (flags >> 2) & 0x07;
+          transparent_index = (flags & 0x01 ? 
+            static_cast<uint8_t>(bytes.at(3)) : -1);
+        }
+        continue;
+      }
+      REQUIRE(byte(pos) == 0x2C);
+      const auto rect = Rect{ word(pos + 1), word(pos + 3), 
+                              word(pos + 5), word(pos + 7) };
+      REQUIRE(!(byte(pos + 9) & 0x40));
+      pos += 10;
+      auto palette = read_palette(pos, byte(pos - 1));
+      if (palette.empty())
+        palette = global_palette;
+      const auto min_code_size = byte(pos++);
+      const auto indices = decode_lzw(read_sub_blocks(pos), min_code_size);
+      REQUIRE(indices.size() >= to_unsigned(rect.w * rect.h));
+
+      for (auto y = 0, i = 0; y < rect.h; ++y)
+        for (auto x = 0; x < rect.w; ++x, ++i) {
+          const auto index = static_cast<uint8_t>(indices[to_unsigned(i)]);
+          if (index != transparent_index)
+            canvas.rgba_at({ rect.x + x, rect.y + y }) = palette.at(index);
+        }
+      frames.push_back({ rect, canvas.clone() });
+
+      if (disposal == 2)
+        for (auto y = rect.y; y < rect.y1(); ++y)
+          for (auto x = rect.x; x < rect.x1(); ++x)
+            canvas.rgba_at({ x, y }) = RGBA{ };
+      disposal = 0;
+      transparent_index = -1;
+    }
+    return frames;
+  }
+} // namespace
+
+TEST_CASE("image - PNG roundtrip") {
+  const auto path = std::filesystem::temp_directory_path();
+  const auto filename = std::filesystem::path("spright-test.png");
+  for (auto [width, height] : { Size{ 1, 1 }, Size{ 37, 19 }, Size{ 300, 1200 } }) {
+    const auto image = get_test_image(width, height);
+    for (auto filter : { PngFilter::adaptive, PngFilter::none, PngFilter::sub, 
+                         PngFilter::up, PngFilter::average, PngFilter::paeth })
+      for (auto level : { 0, 1, 8, 10 }) {
+        save_image(image, path / filename, level, filter);
+        const auto loaded = Image(path, filename);
+        REQUIRE(loaded.bounds() == image.bounds());
+        CHECK(is_identical(image, image.bounds(), loaded, loaded.bounds()));
+      }
+  }
+  std::filesystem::remove(path / filename);
+}
+
+TEST_CASE("image - PNG written in bands") {
+  const auto path = std::filesystem::temp_directory_path();
+  const auto filename = std::filesystem::path("spright-test-bands.png");
+  const auto image = get_test_image(37, 300);
+  {
+    auto writer = PngWriter(path / filename, image.width(), image.height(),
+      8, PngFilter::adaptive);
+    for (auto [y, h] : { std::pair{ 0, 1 }, { 1, 120 }, { 121, 179 } })
+      REQUIRE(writer.write_rows(image.clone({ 0, y, image.width(), h })));
+    CHECK(!writer.write_rows(image.clone({ 0, 0, image.width(), 1 })));
+    REQUIRE(writer.finish());
+  }
+  const auto loaded = Image(path, filename);
+  REQUIRE(loaded.bounds() == image.bounds());
+  CHECK(is_identical(image, image.bounds(), loaded, loaded.bounds()));
+  std::filesystem::remove(path / filename);
+}
+
+TEST_CASE("image - APNG default image") {
+  const auto path = std::filesystem::temp_directory_path();
+  const auto filename = std::filesystem::path("spright-test-animation.png");
+  auto animation = Animation{ };
+  animation.loop_count = 0;
+  for (auto i = 0; i < 3; ++i) {
+    auto image = get_test_image(37, 19);
+    image.rgba_at({ 5 + i, 7 }) = RGBA{ { 1, 2, 3, 4 } };
+    animation.frames.push_back({ i, std::move(image), 0.1 });
+  }
+  save_animation(animation, path / filename);
+  // decoders without APNG support show the first frame
+  const auto loaded = Image(path, filename);
+  const auto& first = animation.frames.front().image;
+  REQUIRE(loaded.bounds() == first.bounds());
+  CHECK(is_identical(first, first.bounds(), loaded, loaded.bounds()));
+  std::filesystem::remove(path / filename);
+}
+
+TEST_CASE("image - GIF roundtrip") {
+  const auto path = std::filesystem::temp_directory_path();
+  const auto filename = path / "spright-test-animation.gif";
+  const auto key = RGBA{ { 255, 0, 255, 255 } };
+  const auto fill = [](Image& image, const Rect& rect, const RGBA& color) {
+    for (auto y = rect.y; y < rect.y1(); ++y)
+      for (auto x = rect.x; x < rect.x1(); ++x)
+        image.rgba_at({ x, y }) = color;
+  };
+
+  const auto save_and_load = [&](const Animation& animation) {
+    save_animation(animation, filename);
+    auto file = std::ifstream(filename, std::ios::binary);
+    const auto data = std::string(std::istreambuf_iterator<char>(file), { });
+    file.close();
+    std::filesystem::remove(filename);
+
+    auto images = std::vector<Image>();
+    for (auto& frame : decode_gif(data))
+      if (frame.image.width() == 16 && frame.image.height() == 16)
+        images.push_back(std::move(frame.image));
+    return images;
+  };
+
+  const auto compare = [](const Image& decoded, const Image& source, 
+      const std::optional<RGBA>& color_key) {
+    auto differences = 0;
+    for (auto y = 0; y < source.height(); ++y)
+      for (auto x = 0; x < source.width(); ++x) {
+        const auto& expected = source.rgba_at({ x, y });
+        const auto& actual = decoded.rgba_at({ x, y });
+        if (color_key && expected == *color_key ? 
+              actual.a != 0 : actual != expected)
+          ++differences;
+      }
+    return differences;
+  };
+
+  // pixels change, and some are cleared to the transparent color key
+  auto animation = Animation{ };
+  animation.loop_count = 0;
+  animation.color_key = key;
+  auto image = Image(16, 16, key);
+  fill(image, { 2, 2, 8, 8 }, RGBA{ { 255, 0, 0, 255 } });
+  fill(image, { 8, 4, 6, 6 }, RGBA{ { 0, 255, 0, 255 } });
+  animation.frames.push_back({ 0, image.clone(), 0.1 });
+  fill(image, { 3, 3, 2, 2 }, RGBA{ { 0, 0, 255, 255 } });
+  fill(image, { 12, 12, 2, 2 }, RGBA{ { 255, 255, 0, 255 } });
+  animation.frames.push_back({ 1, image.clone(), 0.1 });
+  fill(image, { 2, 2, 4, 4 }, key);
+  fill(image, { 12, 12, 1, 1 }, key);
+  animation.frames.push_back({ 2, image.clone(), 0.1 });
+
+  auto decoded = save_and_load(animation);
+  REQUIRE(decoded.size() == 3);
+  for (auto i = 0u; i < 3; ++i)
+    CHECK(compare(decoded[i], animation.frames[i].image, key) == 0);
+
+  // without color key all 256 palette entries are opaque
+  animation.color_key.reset();
+  for (auto i = 0; i < 3; ++i) {
+    auto& frame = animation.frames[static_cast<size_t>(i)].image;
+    for (auto y = 0; y < 16; ++y)
+      for (auto x = 0; x < 16; ++x) {
+        const auto color = ((y + (y < 8 ? i : 0)) % 16) * 16 + x;
+        frame.rgba_at({ x, y }) = RGBA{ { to_byte(color),
+          to_byte(255 - color), to_byte(color * 7), 255 } };
+      }
+  }
+  decoded = save_and_load(animation);
+  REQUIRE(decoded.size() == 3);
+  for (auto i = 0u; i < 3; ++i)
+    CHECK(compare(decoded[i], animation.frames[i].image, { }) == 0);
+}
+
+TEST_CASE("image - GIF frame regions") {
+  const auto path = std::filesystem::temp_directory_path();
+  const auto filename = path / "spright-test-animation.gif";
+  const auto key = RGBA{ { 255, 0, 255, 255 } };
+
+  // a sprite moves over a transparent canvas
+  auto animation = Animation{ };
+  animation.loop_count = 0;
+  animation.color_key = key;
+  for (auto i = 0; i < 8; ++i) {
+    auto image = Image(32, 32, key);
+    for (auto y = 10; y < 14; ++y)
+      for (auto x = 4 + i; x < 8 + i; ++x)
+        image.rgba_at({ x, y }) = RGBA{ { to_byte(100 + x * 10), 0, 0, 255 } };
+    animation.frames.push_back({ i, std::move(image), 0.1 });
+  }
+  save_animation(animation, filename);
+  auto file = std::ifstream(filename, std::ios::binary);
+  const auto data = std::string(std::istreambuf_iterator<char>(file), { });
+  file.close();
+  std::filesystem::remove(filename);
+
+  // after the first frame only the sprite is written
+  const auto frames = decode_gif(data);
+  REQUIRE(frames.size() == 8);
+  CHECK(frames[0].rect == Rect{ 0, 0, 32, 32 });
+  for (auto i = 1u; i < frames.size(); ++i)
+    CHECK(frames[i].rect == Rect{ 4 + static_cast<int>(i), 10, 4, 4 });
+
+  for (auto i = 0u; i < frames.size(); ++i) {
+    auto differences = 0;
+    const auto& source = animation.frames[i].image;
+    for (auto y = 0; y < 32; ++y)
+      for (auto x = 0; x < 32; ++x) {
+        const auto& expected = source.rgba_at({ x, y });
+        const auto& actual = frames[i].image.rgba_at({ x, y });
+        if (expected == key ? actual.a != 0 : actual != expected)
+          ++differences;
+      }
+    CHECK(differences == 0);
+  }
+}
+
+TEST_CASE("image - Masked copy") {
+  const auto source = get_test_image(40, 30);
+  const auto source_rect = Rect{ 3, 2, 31, 23 };
+  const auto [w, h] = source_rect.size();
+  const auto polygons = std::vector<std::vector<PointF>>{
+    { { 0, 0 }, { 31, 0 }, { 31, 23 }, { 0, 23 } },
+    { { 15.5, -2 }, { 33, 11.5 }, { 15.5, 25 }, { -2, 11.5 } },
+    { { 0.3, 4.7 }, { 12.5, 0.5 }, { 30.1, 6.2 }, { 22.8, 22.9 }, { 3.5, 19.5 } },
+    { { 0, 0 }, { 31, 0 }, { 16, 12 }, { 31, 23 }, { 0, 23 }, { 8, 11.5 } },
+  };
+  for (const auto& vertices : polygons) {
+    auto dest = Image(40, 40, RGBA{ });
+    auto expected = Image(40, 40, RGBA{ });
+    copy_rect(source, source_rect, dest, 5, 7, vertices);
+    for (auto y = 0; y < h; ++y)
+      for (auto x = 0; x < w; ++x)
+        if (point_in_polygon(x + 0.5, y + 0.5, vertices))
+          expected.rgba_at({ 5 + x, 7 + y }) = 
+            source.rgba_at({ source_rect.x + x, source_rect.y + y });
+    CHECK(is_identical(dest, dest.bounds(), expected, expected.bounds()));
+
+    dest = Image(40, 40, RGBA{ });
+    expected = Image(40, 40, RGBA{ });
+    copy_rect_rotated_cw(source, source_rect, dest, 6, 4, vertices);
+    for (auto y = 0; y < h; ++y)
+      for (auto x = 0; x < w; ++x)
+        if (point_in_polygon(x + 0.5, y + 0.5, vertices))
+          expected.rgba_at({ 6 + (h - 1 - y), 4 + x }) = 
+            source.rgba_at({ source_rect.x + x, source_rect.y + y });
+    CHECK(is_identical(dest, dest.bounds(), expected, expected.bounds()));
+  }
+}
+
+TEST_CASE("image - Rotated copy") {
+  const auto source = get_test_image(150, 90);
+  for (auto source_rect : { Rect{ 0, 0, 150, 90 }, Rect{ 1, 2, 3, 5 },
+                            Rect{ 5, 3, 67, 81 }, Rect{ 0, 7, 128, 64 } }) {
+    const auto [w, h] = source_rect.size();
+    auto dest = Image(100, 160, RGBA{ });
+    auto expected = Image(100, 160, RGBA{ });
+    copy_rect_rotated_cw(source, source_rect, dest, 3, 1);
+    for (auto y = 0; y < h; ++y)
+      for (auto x = 0; x < w; ++x)
+        expected.rgba_at({ 3 + (h - 1 - y), 1 + x }) = 
+          source.rgba_at({ source_rect.x + x, source_rect.y + y });
+    CHECK(is_identical(dest, dest.bounds(), expected, expected.bounds()));
+  }
+}
+
+TEST_CASE("image - Used bounds") {
+  const auto reference = [](const Image& image, bool gray_levels,
+      int threshold, const Rect& rect) {
+    auto min_x = rect.x + rect.w, max_x = -1, min_y = rect.y + rect.h, max_y = -1;
+    for (auto y = rect.y; y < rect.y + rect.h; ++y)
+      for (auto x = rect.x; x < rect.x + rect.w; ++x) {
+        const auto& rgba = image.rgba_at({ x, y });
+        if ((gray_levels ? rgba.gray() : rgba.a) >= threshold) {
+          min_x = std::min(min_x, x);
+          max_x = std::max(max_x, x);
+          min_y = std::min(min_y, y);
+          max_y = std::max(max_y, y);
+        }
+      }
+    if (max_x < 0)
+      return Rect{ rect.x + rect.w - 1, rect.y + rect.h - 1, 1, 1 };
+    return Rect{ min_x, min_y, max_x - min_x + 1, max_y - min_y + 1 };
+  };
+
+  auto image = Image(37, 29, RGBA{ });
+  CHECK(get_used_bounds(image, false) == Rect{ 36, 28, 1, 1 });
+
+  for (auto [x, y, a] : { std::tuple{ 20, 14, 255 }, { 3, 22, 100 },
+                          { 33, 5, 10 }, { 0, 0, 200 }, { 36, 28, 1 } }) {
+    image.rgba_at({ x, y }) = RGBA{ {
+      to_byte(a), to_byte(255 - a), 0, to_byte(a) } };
+    for (auto gray_levels : { false, true })
+      for (auto threshold : { 0, 1, 50, 150, 256 })
+        for (auto rect : { image.bounds(), Rect{ 1, 1, 34, 27 },
+                           Rect{ 2, 3, 5, 4 }, Rect{ 19, 0, 18, 29 } })
+          CHECK(get_used_bounds(image, gray_levels, threshold, rect) ==
+                reference(image, gray_levels, threshold, rect));
+  }
+}
+
+TEST_CASE("image - Alpha processing") {
+  // odd size to cover the scalar remainder
+  auto source = get_test_image(301, 257);
+  for (auto y = 0; y < source.height(); y += 3)
+    source.rgba_at({ y % source.width(), y }).a = 0;
+  const auto background = RGBA{ { 10, 20, 30, 40 } };
+  const auto size = source.width() * source.height();
+
+  const auto check_each = [&](const Image& image, auto&& expected) {
+    auto mismatches = 0;
+    for (auto i = 0; i < size; ++i)
+      if (image.rgba()[i] != expected(source.rgba()[i]))
+        ++mismatches;
+    CHECK(mismatches == 0);
+  };
+
+  auto image = source.clone();
+  make_opaque(image);
+  check_each(image, [](RGBA c) { c.a = 255; return c; });
+
+  image = source.clone();
+  make_opaque(image, background);
+  check_each(image, [&](RGBA c) { 
+    if (c.a == 0) return background;
+    c.a = 255;
+    return c;
+  });
+
+  image = source.clone();
+  clear_alpha(image, background);
+  check_each(image, [&](RGBA c) { return (c.a == 0 ? background : c); });
+
+  for (auto exact : { false, true }) {
+    image = source.clone();
+    premultiply_alpha(image, exact);
+    check_each(image, [&](RGBA c) {
+      const auto multiply = [&](uint8_t& v) {
+        v = to_byte(exact ? (v * c.a + 127) / 255 : v * c.a / 256);
+      };
+      multiply(c.r);
+      multiply(c.g);
+      multiply(c.b);
+      return c;
+    });
+  }
+
+  // all combinations of channel and alpha
+  image = Image(256, 256);
+  for (auto a = 0; a < 256; ++a)
+    for (auto v = 0; v < 256; ++v)
+      image.rgba_at({ v, a }) = RGBA{ { to_byte(v), to_byte(v), to_byte(v), to_byte(a) } };
+  premultiply_alpha(image, true);
+  auto mismatches = 0;
+  for (auto a = 0; a < 256; ++a)
+    for (auto v = 0; v < 256; ++v)
+      if (image.rgba_at({ v, a }).r != (v * a + 127) / 255)
+        ++mismatches;
+  CHECK(mismatches == 0);
+}
+
+TEST_CASE("image - Quantize") {
+  const auto image = get_test_image(97, 61);
+  auto palette = generate_palette(image, 37);
+  // equal colors should resolve to the lowest index
+  palette.push_back(palette[5]);
+  palette.insert(palette.begin(), palette[20]);
+
+  const auto mono = quantize_image(image, palette, false);
+  auto mismatches = 0;
+  for (auto y = 0; y < image.height(); ++y)
+    for (auto x = 0; x < image.width(); ++x) {
+      const auto& color = image.rgba_at({ x, y });
+      auto min_index = 0;
+      auto min_distance = std::numeric_limits<int>::max();
+      for (auto i = 0; i < static_cast<int>(palette.size()); ++i) {
+        const auto& entry = palette[static_cast<size_t>(i)];
+        const auto r = entry.r - color.r;
+        const auto g = entry.g - color.g;
+        const auto b = entry.b - color.b;
+        if (r * r + g * g + b * b < min_distance) {
+          min_distance = r * r + g * g + b * b;
+          min_index = i;
+        }
+      }
+      if (mono.value_at({ x, y }) != min_index)
+        ++mismatches;
+    }
+  CHECK(mismatches == 0);
+
+  // the appended duplicate is never chosen
+  const auto dithered = quantize_image(image, palette, true);
+  auto out_of_range = 0;
+  for (auto y = 0; y < image.height(); ++y)
+    for (auto x = 0; x < image.width(); ++x)
+      if (dithered.value_at({ x, y }) >= palette.size() - 1)
+        ++out_of_range;
+  CHECK(out_of_range == 0);
+}
+
+TEST_CASE("image - Generate palette") {
+  const auto colors = std::vector<RGBA>{
+    RGBA{ { 255, 0, 0, 255 } }, RGBA{ { 0, 255, 0, 255 } },
+    RGBA{ { 0, 0, 255, 255 } }, RGBA{ { 10, 20, 30, 128 } },
+  };
+  auto image = Image(64, 64, RGBA{ });
+  for (auto y = 0; y < 32; ++y)
+    for (auto x = 0; x < 64; ++x)
+      image.rgba_at({ x, y }) = colors[static_cast<size_t>((x / 3 + y) % 4)];
+
+  // fully transparent pixels are skipped
+  auto palette = generate_palette(image, 16);
+  CHECK(palette.size() == colors.size());
+  for (const auto& color : colors)
+    CHECK(std::count(palette.begin(), palette.end(), color) == 1);
+
+  // more distinct colors than the exact histogram holds
+  image = Image(512, 512);
+  for (auto y = 0; y < 512; ++y)
+    for (auto x = 0; x < 512; ++x)
+      image.rgba_at({ x, y }) = RGBA{ { to_byte(x), to_byte(y), 
+        to_byte((x / 256) * 128 + (y / 256) * 64), 255 } };
+  palette = generate_palette(image, 256);
+  CHECK(palette.size() == 256);
+
+  CHECK(generate_palette(Image(4, 4, RGBA{ }), 256).size() == 1);
+}
+
+TEST_CASE("image - Block compression") {
+  auto pixels = std::array<RGBA, 16>{ };
+  for (auto i = 0; i < 16; ++i)
+    pixels[static_cast<size_t>(i)] = RGBA{ { to_byte(64 + i % 4 * 30), 
+      to_byte(128 + i % 4 * 15), to_byte(32), 255 } };
+
+  // four colors on a line are approximated closely
+  auto block = std::array<uint8_t, 16>{ };
+  encode_bc1_block(pixels.data(), block.data());
+  auto decoded = decode_bc1_block(block.data());
+  auto max_difference = 0;
+  for (auto i = 0u; i < 16; ++i)
+    for (auto c = 0; c < 4; ++c)
+      max_difference = std::max(max_difference, 
+        std::abs(decoded[i].channel(c) - pixels[i].channel(c)));
+  CHECK(max_difference <= 8);
+
+  // transparent pixels stay transparent
+  pixels[3].a = 0;
+  pixels[12].a = 0;
+  encode_bc1_block(pixels.data(), block.data());
+  decoded = decode_bc1_block(block.data());
+  for (auto i = 0u; i < 16; ++i)
+    CHECK((decoded[i].a == 0) == (pixels[i].a == 0));
+
+  // BC3 stores the alpha end points before the color block
+  encode_bc3_block(pixels.data(), block.data());
+  CHECK(block[0] == 255);
+  CHECK(block[1] == 0);
+  decoded = decode_bc1_block(block.data() + 8);
+  CHECK(std::abs(decoded[0].r - pixels[0].r) <= 10);
+
+  // BC7 uses mode 5 or 6
+  encode_bc7_block(pixels.data(), block.data());
+  CHECK((block[0] == 0x20 || (block[0] & 0x7F) == 0x40));
+
+  // mip chain down to 1x1 with a 148 byte DX10 header
+  const auto path = std::filesystem::temp_directory_path();
+  const auto filename = std::filesystem::path("spright-test.dds");
+  const auto levels = generate_mip_levels(get_test_image(37, 19), 0, 
+    ResizeFilter::box, false);
+  REQUIRE(levels.size() == 6);
+  CHECK(levels.back().width() == 1);
+  save_texture(levels, path / filename, TextureEncoding::bc7);
+  CHECK(std::filesystem::file_size(path / filename) == 148 + 16 * 
+    (10 * 5 + 5 * 3 + 3 * 1 + 1 + 1 + 1));
+  auto file = std::ifstream(path / filename, std::ios::binary);
+  auto header = std::array<char, 148>{ };
+  file.read(header.data(), header.size());
+  REQUIRE(file.good());
+  CHECK(static_cast<uint8_t>(header[128]) == 99); // DXGI_FORMAT_BC7_UNORM_SRGB
+  CHECK(static_cast<uint8_t>(header[144]) == 1); // DDS_ALPHA_MODE_STRAIGHT
+  file.close();
+  std::filesystem::remove(path / filename);
+}
+
+TEST_CASE("image - ETC2 compression") {
+  const auto max_difference = [](const std::array<RGBA, 16>& a,
+      const std::array<RGBA, 16>& b, int first_channel, int last_channel) {
+    auto difference = 0;
+    for (auto i = 0u; i < 16; ++i)
+      for (auto c = first_channel; c <= last_channel; ++c)
+        difference = std::max(difference, std::abs(a[i].channel(c) - b[i].channel(c)));
+    return difference;
+  };
+
+  // two flat halves are stored in the base colors
+  auto pixels = std::array<RGBA, 16>{ };
+  for (auto i = 0; i < 16; ++i)
+    pixels[static_cast<size_t>(i)] = (i % 4 < 2 ?
+      RGBA{ { 200, 40, 30, 255 } } : RGBA{ { 20, 60, 220, 255 } });
+  auto block = std::array<uint8_t, 16>{ };
+  encode_etc2_block(pixels.data(), block.data());
+  CHECK(max_difference(decode_etc2_block(block.data()), pixels, 0, 3) <= 8);
+
+  // same for the flipped halves
+  for (auto i = 0; i < 16; ++i)
+    pixels[static_cast<size_t>(i)] = (i / 4 < 2 ?
+      RGBA{ { 200, 40, 30, 255 } } : RGBA{ { 20, 60, 220, 255 } });
+  encode_etc2_block(pixels.data(), block.data());
+  CHECK(block[3] & 1);
+  CHECK(max_difference(decode_etc2_block(block.data()), pixels, 0, 3) <= 8);
+
+  // brightness gradients are approximated by the modifiers
+  for (auto i = 0; i < 16; ++i)
+    pixels[static_cast<size_t>(i)] = RGBA{ { to_byte(64 + i % 4 * 20),
+      to_byte(80 + i % 4 * 20), to_byte(32 + i % 4 * 20), 255 } };
+  encode_etc2_block(pixels.data(), block.data());
+  CHECK(max_difference(decode_etc2_block(block.data()), pixels, 0, 2) <= 8);
+
+  // EAC stores the alpha block before the color block
+  for (auto i = 0; i < 16; ++i)
+    pixels[static_cast<size_t>(i)].a = to_byte(15 + i * 16);
+  encode_etc2_eac_block(pixels.data(), block.data());
+  auto decoded = decode_etc2_block(block.data() + 8);
+  decode_eac_alpha_block(block.data(), decoded);
+  CHECK(max_difference(decoded, pixels, 3, 3) <= 18);
+  CHECK(max_difference(decoded, pixels, 0, 2) <= 8);
+
+  // constant alpha is exact, color of transparent pixels does not matter
+  for (auto i = 0; i < 16; ++i)
+    pixels[static_cast<size_t>(i)] = (i % 2 ?
+      RGBA{ { 255, 255, 255, 0 } } : RGBA{ { 100, 120, 140, 0 } });
+  encode_etc2_eac_block(pixels.data(), block.data());
+  decoded = decode_etc2_block(block.data() + 8);
+  decode_eac_alpha_block(block.data(), decoded);
+  CHECK(max_difference(decoded, pixels, 3, 3) == 0);
+
+  // only KTX2 has ETC2 formats
+  const auto path = std::filesystem::temp_directory_path();
+  const auto levels = generate_mip_levels(get_test_image(37, 19), 0,
+    ResizeFilter::box, false);
+  CHECK_THROWS(save_texture(levels, path / "spright-test.dds", TextureEncoding::etc2));
+
+  const auto filename = path / "spright-test.ktx2";
+  save_texture(levels, filename, TextureEncoding::etc2_eac, true);
+  auto file = std::ifstream(filename, std::ios::binary);
+  auto header = std::array<char, 80>{ };
+  file.read(header.data(), header.size());
+  REQUIRE(file.good());
+  CHECK(static_cast<uint8_t>(header[12]) == 152); // VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK
+  const auto dfd_offset = static_cast<uint8_t>(header[48]);
+  file.seekg(dfd_offset + 12);
+  auto color_model = std::array<char, 4>{ };
+  file.read(color_model.data(), color_model.size());
+  REQUIRE(file.good());
+  CHECK(static_cast<uint8_t>(color_model[2]) == 2); // KHR_DF_TRANSFER_SRGB
+  CHECK(static_cast<uint8_t>(color_model[3]) == 1); // KHR_DF_FLAG_ALPHA_PREMULTIPLIED
+  file.close();
+  std::filesystem::remove(filename);
+}
+
+TEST_CASE("image - Mip levels") {
+  auto levels = generate_mip_levels(get_test_image(37, 19), 3,
+    ResizeFilter::undefined, false);
+  REQUIRE(levels.size() == 3);
+  CHECK(levels[1].bounds() == Rect{ 0, 0, 18, 9 });
+  CHECK(levels[2].bounds() == Rect{ 0, 0, 9, 4 });
+  CHECK(generate_mip_levels(get_test_image(37, 19), 1,
+    ResizeFilter::box, false).size() == 1);
+
+  // resizing in bands of rows does not introduce seams
+  auto gradient = Image(4, 1000);
+  for (auto y = 0; y < gradient.height(); ++y)
+    for (auto x = 0; x < gradient.width(); ++x)
+      gradient.rgba_at({ x, y }) = RGBA{ { to_byte(y / 4), 0, 0, 255 } };
+  for (auto height : { 300, 1000, 2345 }) {
+    const auto resized = resize_image(gradient, { 4, height }, 
+      ResizeFilter::triangle);
+    auto decreasing = 0;
+    for (auto y = 1; y < height; ++y)
+      if (resized.rgba_at({ 0, y }).r < resized.rgba_at({ 0, y - 1 }).r)
+        ++decreasing;
+    CHECK(decreasing == 0);
+  }
+}
+
+TEST_CASE("image - Resizing rows") {
+  // resizing rows gives the same result, when the filter support is included
+  const auto image = get_test_image(40, 200);
+  for (auto [height, filter] : { std::pair{ 73, ResizeFilter::mitchell },
+                                 { 517, ResizeFilter::cubic_spline } }) {
+    const auto resized = resize_image(image, { 17, height }, filter);
+    const auto y0 = height / 3;
+    const auto y1 = height / 2;
+    const auto source_y0 = y0 * 200 / height - 8;
+    const auto source_y1 = y1 * 200 / height + 8;
+    auto rows = Image(17, y1 - y0);
+    resize_image_rows(image.clone({ 0, source_y0, 40, source_y1 - source_y0 }),
+      source_y0, 200, rows, y0, height, filter);
+    CHECK(is_identical(resized, { 0, y0, 17, y1 - y0 }, rows, rows.bounds()));
+  }
+}
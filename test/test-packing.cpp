@@ -5,7 +5,10 @@
 #include "src/packing.h"
 #include "src/output.h"
 #include "src/debug.h"
+#include "src/layout_cache.h"
 #include <sstream>
+#include <fstream>
+#include <set>
 
 using namespace spright;
 
@@ -22,14 +25,51 @@ namespace {
     return true;
   }
 
-  std::vector<Slice> pack(const char* definition) {
+  bool inside_convex(const std::vector<PointF>& polygon, const PointF& point) {
+    auto sides = 0;
+    for (auto i = size_t{ }; i < polygon.size(); ++i) {
+      const auto& a = polygon[i];
+      const auto& b = polygon[(i + 1) % polygon.size()];
+      const auto cross = (b.x - a.x) * (point.y - a.y) - (b.y - a.y) * (point.x - a.x);
+      sides |= (cross > 0 ? 1 : cross < 0 ? 2 : 0);
+    }
+    return (sides != 3);
+  }
+
+  // counts pixels within the sprites' outlines, which cover each other
+  int count_overlapping_pixels(const Slice& slice) {
+    auto covered = std::set<std::pair<int, int>>();
+    auto overlapping = 0;
+    for (const auto& sprite : slice.sprites) {
+      const auto [w, h] = sprite.trimmed_source_rect.size();
+      for (auto y = 0; y < h; ++y)
+        for (auto x = 0; x < w; ++x) {
+          if (!inside_convex(sprite.vertices, { x + 0.5, y + 0.5 }))
+            continue;
+          const auto [tx, ty] = (sprite.rotated ? Point{ h - 1 - y, x } : Point{ x, y });
+          if (!covered.emplace(sprite.trimmed_rect.x + tx,
+                               sprite.trimmed_rect.y + ty).second)
+            ++overlapping;
+        }
+    }
+    return overlapping;
+  }
+
+  std::vector<Sprite> parse(const std::string& definition) {
     auto input = std::stringstream(definition);
     auto parser = InputParser(Settings{ });
     parser.parse(input);
-    static auto s_sprites = std::vector<Sprite>();
-    s_sprites = std::move(parser).sprites();
+    return std::move(parser).sprites();
+  }
+
+  // sprites of the last call of pack, referenced by its slices
+  std::vector<Sprite> s_sprites;
+
+  std::vector<Slice> pack(const char* definition,
+      const PreviousLayout& previous_layout = { }) {
+    s_sprites = parse(definition);
     trim_sprites(s_sprites);
-    auto slices = pack_sprites(s_sprites);
+    auto slices = pack_sprites(s_sprites, previous_layout);
     if (has_warnings())
       throw std::runtime_error("has warnings");
     return slices;
@@ -55,6 +95,21 @@ namespace {
   #endif
     return slices[0];
   };
+
+  // packing the definition again results in the same sprite rects
+  void check_deterministic(const char* definition, const std::vector<Slice>& slices) {
+    const auto get_rects = [](const std::vector<Slice>& slices) {
+      auto rects = std::vector<std::pair<int, Rect>>();
+      for (const auto& slice : slices)
+        for (const auto& sprite : slice.sprites)
+          rects.emplace_back(slice.index, sprite.trimmed_rect);
+      return rects;
+    };
+    const auto rects = get_rects(slices);
+    auto repacked = std::vector<Slice>();
+    REQUIRE_NOTHROW(repacked = pack(definition));
+    CHECK(get_rects(repacked) == rects);
+  }
 } // namespace
 
 TEST_CASE("packing - Basic") {
@@ -388,3 +443,584 @@ TEST_CASE("packing - Multiple sheets") {
   CHECK(slices[0].width <= 16);
   CHECK(slices[0].height <= 16);
 }
+
+TEST_CASE("packing - Compact") {
+  const auto definition = R"(
+    sheet "binpack"
+    sheet "compact"
+      pack compact
+    input "test/Items.png"
+      sheet "binpack"
+      colorkey
+      atlas
+      trim convex
+    input "test/Items.png"
+      sheet "compact"
+      colorkey
+      atlas
+      trim convex
+  )";
+  auto slices = std::vector<Slice>();
+  REQUIRE_NOTHROW(slices = pack(definition));
+  REQUIRE(slices.size() == 2);
+  const auto& binpack = slices[0];
+  const auto& compact = slices[1];
+  CHECK(le_size(compact, binpack.width, binpack.height));
+  for (const auto& sprite : compact.sprites)
+    CHECK(containing(Rect{ 0, 0, compact.width, compact.height },
+      sprite.trimmed_rect));
+
+  check_deterministic(definition, slices);
+}
+
+TEST_CASE("packing - Nest") {
+  const auto definition = R"(
+    sheet "binpack"
+      allow-rotate true
+      padding 1
+    sheet "nest"
+      pack nest
+      allow-rotate true
+      padding 1
+    input "test/Items.png"
+      sheet "binpack"
+      colorkey
+      atlas
+      trim convex
+    input "test/Items.png"
+      sheet "nest"
+      colorkey
+      atlas
+      trim convex
+  )";
+  auto slices = std::vector<Slice>();
+  REQUIRE_NOTHROW(slices = pack(definition));
+  REQUIRE(slices.size() == 2);
+  const auto& binpack = slices[0];
+  const auto& nest = slices[1];
+  CHECK(le_size(nest, binpack.width, binpack.height));
+  CHECK(count_overlapping_pixels(nest) == 0);
+  for (const auto& sprite : nest.sprites)
+    CHECK(containing(Rect{ 0, 0, nest.width, nest.height },
+      sprite.trimmed_rect));
+
+  check_deterministic(definition, slices);
+
+  // sprites wider than the sheet fail without scanning every row
+  CHECK_THROWS(pack(R"(
+    sheet "nest"
+      pack nest
+      width 4
+    input "test/Items.png"
+      colorkey
+      atlas
+  )"));
+}
+
+TEST_CASE("packing - Pack effort") {
+  const auto definition = R"(
+    sheet "default"
+    sheet "fastest"
+      pack-effort 0
+    sheet "search"
+      pack-effort 6
+    input "test/Items.png"
+      sheet "default"
+      colorkey
+      atlas
+    input "test/Items.png"
+      sheet "fastest"
+      colorkey
+      atlas
+    input "test/Items.png"
+      sheet "search"
+      colorkey
+      atlas
+  )";
+  auto slices = std::vector<Slice>();
+  REQUIRE_NOTHROW(slices = pack(definition));
+  REQUIRE(slices.size() == 3);
+  // searching all heuristics is at least as good as the fastest and
+  // the default, which keeps the best of them by the same criterion
+  const auto area = [](const Slice& slice) { return slice.width * slice.height; };
+  CHECK(area(slices[2]) <= area(slices[0]));
+  CHECK(area(slices[2]) <= area(slices[1]));
+  for (const auto& slice : slices)
+    for (const auto& sprite : slice.sprites)
+      CHECK(containing(Rect{ 0, 0, slice.width, slice.height },
+        sprite.trimmed_rect));
+
+  // heuristics are chosen independently of the thread count
+  const auto get_rects = [&]() {
+    auto rects = std::vector<std::pair<int, Rect>>();
+    for (const auto& slice : pack(definition))
+      for (const auto& sprite : slice.sprites)
+        rects.emplace_back(slice.index, sprite.trimmed_rect);
+    return rects;
+  };
+  const auto rects = get_rects();
+  scheduler.configure(1);
+  CHECK(get_rects() == rects);
+  scheduler.configure(0);
+  CHECK(get_rects() == rects);
+}
+
+TEST_CASE("packing - Incremental") {
+  const auto definition = R"(
+    sheet "sprites"
+      incremental
+    input "test/Items.png"
+      colorkey
+      atlas
+  )";
+  const auto extended_definition = R"(
+    sheet "sprites"
+      incremental
+    input "test/Items.png"
+      colorkey
+      atlas
+    input "test/Items.png"
+      sprite
+        rect 0 0 4 4
+  )";
+  auto slices = std::vector<Slice>();
+  REQUIRE_NOTHROW(slices = pack(definition));
+  REQUIRE(slices.size() == 1);
+  auto previous_layout = PreviousLayout();
+  auto rects = std::map<int, Rect>();
+  for (const auto& sprite : slices[0].sprites) {
+    previous_layout[sprite.index] = {
+      slices[0].sheet_index, { slices[0].width, slices[0].height },
+      { sprite.trimmed_rect.x - sprite.align.x,
+        sprite.trimmed_rect.y - sprite.align.y },
+      sprite.bounds, sprite.rotated };
+    rects[sprite.index] = sprite.trimmed_rect;
+  }
+
+  // new sprite is placed in free space, others keep their position
+  REQUIRE_NOTHROW(slices = pack(extended_definition, previous_layout));
+  REQUIRE(slices.size() == 1);
+  const auto& slice = slices[0];
+  CHECK(slice.sprites.size() == rects.size() + 1);
+  for (const auto& sprite : slice.sprites) {
+    CHECK(containing(Rect{ 0, 0, slice.width, slice.height },
+      sprite.trimmed_rect));
+    if (rects.count(sprite.index))
+      CHECK(sprite.trimmed_rect == rects[sprite.index]);
+    for (const auto& other : slice.sprites)
+      if (&other != &sprite)
+        CHECK(!overlapping(sprite.trimmed_rect, other.trimmed_rect));
+  }
+
+  // sprites of slice 0 were removed, the kept slice becomes slice 0
+  for (auto& [index, placement] : previous_layout)
+    placement.slice_index = 1;
+  REQUIRE_NOTHROW(slices = pack(definition, previous_layout));
+  REQUIRE(slices.size() == 1);
+  CHECK(slices[0].index == 0);
+  CHECK(slices[0].sheet_index == 0);
+  for (const auto& sprite : slices[0].sprites) {
+    CHECK(sprite.slice_index == 0);
+    CHECK(sprite.trimmed_rect == rects[sprite.index]);
+  }
+}
+
+TEST_CASE("packing - Slice order") {
+  auto slices = std::vector<Slice>();
+  REQUIRE_NOTHROW(slices = pack(R"(
+    sheet "a"
+      max-width 40
+      max-height 40
+      output "a{0-}.png"
+    sheet "b"
+      pack rows
+      duplicates share
+      max-width 40
+      max-height 40
+      output "b{0-}.png"
+    sheet "c"
+      duplicates share
+      output "c.png"
+    input "test/Items.png"
+      sheet "a"
+      colorkey
+      atlas
+    input "test/Items.png"
+      sheet "c"
+      colorkey
+      atlas
+    input "test/Items.png"
+      sheet "b"
+      colorkey
+      atlas
+    input "test/Items.png"
+      sheet "c"
+      colorkey
+      atlas
+    input "test/Items.png"
+      sheet "b"
+      colorkey
+      atlas
+  )"));
+  REQUIRE(slices.size() > 3);
+
+  // slices are ordered by sheet, then by index within the sheet
+  auto previous = std::make_pair(-1, -1);
+  for (const auto& slice : slices) {
+    const auto current = std::make_pair(slice.sheet->index, slice.sheet_index);
+    CHECK(previous < current);
+    previous = current;
+  }
+
+  // sprites and shared duplicates refer to the slices' global index
+  for (const auto& slice : slices)
+    for (const auto& sprite : slice.sprites)
+      CHECK(sprite.slice_index == slice.index);
+
+  auto duplicates = std::map<std::string, int>();
+  for (const auto& sprite : s_sprites) {
+    if (sprite.duplicate_of_index < 0)
+      continue;
+    REQUIRE(sprite.slice_index >= 0);
+    REQUIRE(sprite.slice_index < to_int(slices.size()));
+    const auto& slice = slices[to_unsigned(sprite.slice_index)];
+    CHECK(slice.sheet == sprite.sheet);
+    CHECK(std::count_if(slice.sprites.begin(), slice.sprites.end(),
+      [&](const Sprite& other) {
+        return (other.index == sprite.duplicate_of_index);
+      }) == 1);
+    ++duplicates[sprite.sheet->id];
+  }
+  CHECK(duplicates["b"] > 0);
+  CHECK(duplicates["c"] > 0);
+}
+
+TEST_CASE("packing - Parallel composition") {
+  const auto definitions = {
+    // sprites do not overlap
+    R"(
+      sheet "sprites"
+      input "test/Items.png"
+        colorkey
+        atlas
+    )",
+    // sprites overlap, rows are composed in parallel
+    R"(
+      sheet "sprites"
+        pack origin
+      input "test/Items.png"
+        colorkey
+        atlas
+    )",
+    // sprites overlap and are extruded
+    R"(
+      sheet "sprites"
+        pack origin
+      input "test/Items.png"
+        colorkey
+        extrude 2
+        atlas
+    )",
+  };
+
+  for (const auto definition : definitions) {
+    auto slices = std::vector<Slice>();
+    REQUIRE_NOTHROW(slices = pack(definition));
+    REQUIRE(!slices.empty());
+    for (const auto& slice : slices) {
+      scheduler.configure(4);
+      const auto parallel = get_slice_image(slice);
+      scheduler.configure(1);
+      const auto sequential = get_slice_image(slice);
+      scheduler.configure(0);
+
+      REQUIRE(parallel.width() == sequential.width());
+      REQUIRE(parallel.height() == sequential.height());
+      const auto count = parallel.width() * parallel.height();
+      CHECK(std::equal(parallel.rgba(), parallel.rgba() + count,
+        sequential.rgba()));
+    }
+  }
+}
+
+TEST_CASE("packing - Streaming output") {
+  const auto definitions = {
+    // sprites do not overlap and are extruded
+    R"(
+      sheet "sprites"
+        output "spright-test-streaming.png"
+      input "test/Items.png"
+        colorkey
+        extrude 1
+        atlas
+    )",
+    // sprites overlap and alpha is processed
+    R"(
+      sheet "sprites"
+        pack origin
+        output "spright-test-streaming.png"
+          alpha opaque
+      input "test/Items.png"
+        colorkey
+        atlas
+    )",
+    // rows are resized
+    R"(
+      sheet "sprites"
+        output "spright-test-streaming.png"
+          scale 0.7
+      input "test/Items.png"
+        colorkey
+        atlas
+    )",
+  };
+
+  const auto directory = std::filesystem::temp_directory_path();
+  const auto write = [&](const std::vector<Slice>& slices,
+      const char* subdirectory, int64_t min_pixels) {
+    auto settings = Settings{ };
+    settings.output_path = directory / subdirectory;
+    auto textures = get_textures(settings, slices);
+    REQUIRE(textures.size() == 1);
+    output_textures(textures, min_pixels);
+    const auto filename = utf8_to_path(textures[0].filename);
+    return Image(filename.parent_path(), filename.filename());
+  };
+
+  for (const auto definition : definitions) {
+    auto slices = std::vector<Slice>();
+    REQUIRE_NOTHROW(slices = pack(definition));
+    REQUIRE(slices.size() == 1);
+    const auto streamed = write(slices, "spright-test-streamed", 0);
+    const auto written = write(slices, "spright-test-written",
+      std::numeric_limits<int64_t>::max());
+    REQUIRE(streamed.bounds() == written.bounds());
+    CHECK(is_identical(streamed, streamed.bounds(), written, written.bounds()));
+  }
+
+  // streamed slice equals the composed slice image
+  const auto slices = pack(*definitions.begin());
+  const auto filename = directory / "spright-test-composed.png";
+  save_image(get_slice_image(slices[0]), filename);
+  const auto composed = Image(directory, filename.filename());
+  const auto streamed = write(slices, "spright-test-streamed", 0);
+  REQUIRE(streamed.bounds() == composed.bounds());
+  CHECK(is_identical(streamed, streamed.bounds(), composed, composed.bounds()));
+
+  std::filesystem::remove(filename);
+  std::filesystem::remove_all(directory / "spright-test-streamed");
+  std::filesystem::remove_all(directory / "spright-test-written");
+}
+
+TEST_CASE("packing - Layout cache") {
+  const auto directory = std::filesystem::temp_directory_path();
+  const auto cache = directory / "spright-test.layout-cache";
+  const auto source = directory / "spright-test-items.png";
+  std::filesystem::copy_file("test/Items.png", source,
+    std::filesystem::copy_options::overwrite_existing);
+
+  const auto definition = [&](const char* sheet, const char* input) {
+    return "sheet \"sprites\"\n" + std::string(sheet) +
+      "input \"" + path_to_utf8(source) + "\"\n"
+      "  colorkey\n"
+      "  atlas\n" + std::string(input);
+  };
+
+  // sprite indices with their slice, slice size and rect
+  using Layout = std::map<int, std::tuple<int, Size, Rect>>;
+  const auto get_layout = [](const std::vector<Slice>& slices) {
+    auto layout = Layout();
+    for (const auto& slice : slices)
+      for (const auto& sprite : slice.sprites)
+        layout[sprite.index] = { slice.index,
+          Size{ slice.width, slice.height }, sprite.trimmed_rect };
+    return layout;
+  };
+  const auto store = [&](const std::string& definition) {
+    auto sprites = parse(definition);
+    const auto fingerprint = get_layout_fingerprint(sprites);
+    trim_sprites(sprites);
+    const auto slices = pack_sprites(sprites);
+    store_layout(cache, fingerprint, sprites, slices);
+    return get_layout(slices);
+  };
+  const auto restore = [&](const std::string& definition) {
+    auto sprites = parse(definition);
+    auto slices = std::vector<Slice>();
+    if (!restore_layout(cache, get_layout_fingerprint(sprites), sprites, slices))
+      return std::optional<Layout>();
+    return std::optional<Layout>(get_layout(slices));
+  };
+
+  // restored as stored
+  const auto original = definition("", "");
+  const auto layout = store(original);
+  REQUIRE(layout.size() > 1);
+  CHECK(restore(original) == layout);
+
+  // sheet and sprite settings invalidate the layout
+  CHECK(!restore(definition("  padding 1\n", "")));
+  CHECK(!restore(definition("", "  extrude 1\n")));
+  CHECK(restore(original) == layout);
+
+  // modification time and size of the source invalidate the layout
+  const auto write_time = std::filesystem::last_write_time(source);
+  std::filesystem::last_write_time(source, write_time + std::chrono::seconds(2));
+  CHECK(!restore(original));
+  store(original);
+  CHECK(restore(original) == layout);
+  std::ofstream(source, std::ios::binary | std::ios::app).put(0);
+  std::filesystem::last_write_time(source, write_time + std::chrono::seconds(2));
+  CHECK(!restore(original));
+  store(original);
+  CHECK(restore(original) == layout);
+
+  // layouts without fingerprint are not restored
+  auto sprites = parse(original);
+  trim_sprites(sprites);
+  const auto slices = pack_sprites(sprites);
+  store_layout(cache, 0, sprites, slices);
+  CHECK(!restore(original));
+
+  // truncated and corrupt files are ignored
+  store(original);
+  auto data = read_textfile(cache);
+  for (auto size : { size_t{ }, size_t{ 7 }, data.size() / 2, data.size() - 1 }) {
+    write_textfile(cache, std::string_view(data).substr(0, size));
+    CHECK(!restore(original));
+  }
+  for (auto i = size_t{ }; i < data.size(); i += 37) {
+    auto corrupt = data;
+    corrupt[i] = static_cast<char>(corrupt[i] ^ 0x10);
+    write_textfile(cache, corrupt);
+    CHECK(!restore(original));
+  }
+  write_textfile(cache, data);
+  CHECK(restore(original) == layout);
+
+  CHECK(!has_warnings());
+  std::filesystem::remove(cache);
+  std::filesystem::remove(source);
+}
+
+TEST_CASE("packing - Incremental layout cache") {
+  const auto cache = std::filesystem::temp_directory_path() /
+    "spright-test-incremental.layout-cache";
+  std::filesystem::remove(cache);
+
+  const auto sheet = [](int max_unused) {
+    return "sheet \"sprites\"\n  incremental " +
+      std::to_string(max_unused) + "\n";
+  };
+  const auto atlas = std::string(
+    "input \"test/Items.png\"\n  colorkey\n  atlas\n");
+  const auto sprites = [](std::initializer_list<Size> sizes) {
+    auto definition = std::string("input \"test/Items.png\"\n  colorkey\n");
+    for (const auto& size : sizes)
+      definition += "  sprite\n    rect 0 0 " + std::to_string(size.x) +
+        " " + std::to_string(size.y) + "\n";
+    return definition;
+  };
+
+  // packs using the previous layout and stores the new one,
+  // returns the sprites' rects by source rect and the slice sizes
+  using SourceRect = std::tuple<int, int, int, int>;
+  struct Layout {
+    std::map<SourceRect, Rect> rects;
+    std::vector<Size> slice_sizes;
+  };
+  const auto run = [&](const std::string& definition) {
+    auto sprites = parse(definition);
+    const auto fingerprint = get_layout_fingerprint(sprites);
+    trim_sprites(sprites);
+    const auto slices = pack_sprites(sprites, read_previous_layout(cache, sprites));
+    store_layout(cache, fingerprint, sprites, slices);
+
+    auto layout = Layout{ };
+    for (const auto& slice : slices) {
+      layout.slice_sizes.push_back({ slice.width, slice.height });
+      for (const auto& sprite : slice.sprites) {
+        CHECK(containing(Rect{ 0, 0, slice.width, slice.height },
+          sprite.trimmed_rect));
+        for (const auto& other : slice.sprites)
+          if (&other != &sprite)
+            CHECK(!overlapping(sprite.trimmed_rect, other.trimmed_rect));
+        const auto& rect = sprite.source_rect;
+        layout.rects[{ rect.x, rect.y, rect.w, rect.h }] = sprite.trimmed_rect;
+      }
+    }
+    return layout;
+  };
+  // rects of the previous layout, which are still in the current one
+  const auto count_kept = [](const Layout& previous, const Layout& current) {
+    auto kept = size_t{ };
+    for (const auto& [source_rect, rect] : previous.rects)
+      if (const auto it = current.rects.find(source_rect);
+          it != current.rects.end() && it->second == rect)
+        ++kept;
+    return kept;
+  };
+
+  const auto small = sprites({ { 5, 3 } });
+  const auto resized = sprites({ { 6, 4 } });
+  const auto added = sprites({ { 7, 7 }, { 3, 9 } });
+
+  const auto first = run(sheet(50) + atlas + small);
+  REQUIRE(first.slice_sizes.size() == 1);
+
+  // added sprite is placed in free space
+  const auto second = run(sheet(50) + atlas + small + added);
+  CHECK(second.rects.size() == first.rects.size() + 2);
+  CHECK(count_kept(first, second) == first.rects.size());
+
+  // resized sprite is placed anew, the others are kept
+  const auto third = run(sheet(50) + atlas + resized + added);
+  CHECK(third.rects.size() == second.rects.size());
+  CHECK(count_kept(second, third) == second.rects.size() - 1);
+
+  // sprites are matched independently of the definition order
+  const auto fourth = run(sheet(50) + added + resized + atlas);
+  CHECK(count_kept(third, fourth) == third.rects.size());
+  CHECK(fourth.slice_sizes == third.slice_sizes);
+
+  // layouts of other versions are ignored
+  CHECK(!read_previous_layout(cache, parse(sheet(50) + atlas)).empty());
+  auto data = read_textfile(cache);
+  data.resize(data.size() - sizeof(uint64_t));
+  data[4] = static_cast<char>(data[4] - 1);
+  auto hash = uint64_t{ 14695981039346656037ull };
+  for (auto c : data) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= uint64_t{ 1099511628211ull };
+  }
+  data.append(reinterpret_cast<const char*>(&hash), sizeof(hash));
+  write_textfile(cache, data);
+  CHECK(read_previous_layout(cache, parse(sheet(50) + atlas)).empty());
+
+  // repacked when too much area would be unused
+  run(sheet(100) + atlas + small);
+  const auto kept = run(sheet(100) + small);
+  CHECK(count_kept(kept, first) == 1);
+
+  run(sheet(50) + atlas + small);
+  const auto repacked = run(sheet(50) + small);
+  CHECK(count_kept(repacked, first) == 0);
+  CHECK(repacked.slice_sizes[0].x * repacked.slice_sizes[0].y <
+        kept.slice_sizes[0].x * kept.slice_sizes[0].y);
+
+  // sparse sheets are not repacked, as long as no area becomes unused
+  const auto sparse = sheet(50) + 
+    "  power-of-two true\n  width 512\n  height 512\n";
+  const auto sparse_first = run(sparse + atlas + small);
+  REQUIRE(sparse_first.slice_sizes == std::vector<Size>{ { 512, 512 } });
+  const auto sparse_added = run(sparse + atlas + small + added);
+  CHECK(count_kept(sparse_first, sparse_added) == sparse_first.rects.size());
+  const auto sparse_removed = run(sparse + atlas + small);
+  CHECK(count_kept(sparse_added, sparse_removed) == sparse_first.rects.size());
+  const auto sparse_repacked = run(sheet(1) + 
+    "  power-of-two true\n  width 512\n  height 512\n" + small);
+  CHECK(count_kept(sparse_removed, sparse_repacked) == 0);
+
+  CHECK(!has_warnings());
+  std::filesystem::remove(cache);
+}
@@ -2,8 +2,11 @@
 #include "catch.hpp"
 #include "src/image.h"
 #include "src/FilenameSequence.h"
+#include "src/packing.h"
 #include "rect_pack/rect_pack.h"
+#include "chipmunk/chipmunk.h"
 #include <random>
+#include <cstring>
 
 using namespace spright;
 
@@ -66,6 +69,97 @@ namespace {
     save_image(image, filename);
   }
 
+  // convex sprites of random shape and size
+  std::vector<Sprite> generate_convex_sprites(const SheetPtr& sheet, int count) {
+    auto rand = std::minstd_rand0();
+    auto sprites = std::vector<Sprite>();
+    for (auto i = 0; i < count; ++i) {
+      auto& sprite = sprites.emplace_back();
+      sprite.index = i;
+      sprite.sheet = sheet;
+      const auto w = 12 + to_int(rand() % 49);
+      const auto h = 12 + to_int(rand() % 49);
+      sprite.trimmed_source_rect = { 0, 0, w, h };
+      sprite.bounds = { w, h };
+      const auto fw = to_real(w);
+      const auto fh = to_real(h);
+      if (i % 2) {
+        sprite.vertices = { { 0, fh }, { fw, fh }, { fw / 2, 0 } };
+      }
+      else {
+        for (auto j = 0; j < 8; ++j) {
+          const auto angle = to_real(j) * 2 * 3.14159265 / 8;
+          sprite.vertices.push_back({
+            (1 - std::cos(angle)) * fw / 2, (1 - std::sin(angle)) * fh / 2 });
+        }
+      }
+    }
+    return sprites;
+  }
+
+  // previous implementation of pack compact, a fixed number of steps
+  void compact_sprites_fixed_steps(const Slice& slice, int border_padding,
+      int shape_padding) {
+    const auto space = cpSpaceNew();
+    const auto padding = to_real(shape_padding) / 2.0;
+    const auto border = to_real(border_padding) - padding;
+    const auto x0 = border;
+    const auto y0 = border;
+    const auto x1 = to_real(slice.width) - border - 0.5;
+    const auto y1 = to_real(slice.height) - border - 0.5;
+    const auto static_body = cpSpaceGetStaticBody(space);
+    auto shapes = std::vector<cpShape*>();
+    shapes.push_back(cpSpaceAddShape(space, cpSegmentShapeNew(static_body, cpv(x0, y0), cpv(x1, y0), 0)));
+    shapes.push_back(cpSpaceAddShape(space, cpSegmentShapeNew(static_body, cpv(x0, y1), cpv(x1, y1), 0)));
+    shapes.push_back(cpSpaceAddShape(space, cpSegmentShapeNew(static_body, cpv(x0, y0), cpv(x0, y1), 0)));
+    shapes.push_back(cpSpaceAddShape(space, cpSegmentShapeNew(static_body, cpv(x1, y0), cpv(x1, y1), 0)));
+
+    auto bodies = std::vector<cpBody*>();
+    auto vertices = std::vector<cpVect>();
+    for (const auto& sprite : slice.sprites) {
+      auto body = bodies.emplace_back(cpSpaceAddBody(space, cpBodyNew(1, INFINITY)));
+      cpBodySetPosition(body, {
+        to_real(sprite.trimmed_rect.x),
+        to_real(sprite.trimmed_rect.y),
+      });
+      vertices.clear();
+      for (auto vertex : sprite.vertices) {
+        if (sprite.rotated)
+          vertex = rotate_cw(vertex, sprite.trimmed_rect.h);
+        vertices.push_back({ vertex.x, vertex.y });
+      }
+      shapes.push_back(cpSpaceAddShape(space, cpPolyShapeNew(body,
+        to_int(vertices.size()), vertices.data(), cpTransformIdentity, padding)));
+    }
+
+    for (auto i = 0; i < 1000; i++) {
+      cpSpaceSetGravity(space, cpVect{ 20.0 * ((i / 100) % 2 ? 1 : -1), -100 });
+      cpSpaceStep(space, 1.0 / 60);
+    }
+
+    auto i = 0u;
+    for (const auto& body : bodies) {
+      auto& sprite = slice.sprites[i++];
+      const auto position = cpBodyGetPosition(body);
+      sprite.trimmed_rect.x = to_int(position.x + 0.5);
+      sprite.trimmed_rect.y = to_int(position.y + 0.5);
+    }
+    cpSpaceFree(space);
+    for (auto shape : shapes)
+      cpShapeFree(shape);
+    for (auto body : bodies)
+      cpBodyFree(body);
+  }
+
+  int64_t get_total_area(std::vector<Slice>& slices) {
+    auto area = int64_t{ };
+    for (auto& slice : slices) {
+      recompute_slice_size(slice);
+      area += int64_t{ slice.width } * slice.height;
+    }
+    return area;
+  }
+
   template<typename T>
   bool le_size(const T& texture, int w, int h) {
     // here one can set a breakpoint to tighten the size constraints
@@ -132,3 +226,103 @@ TEST_CASE("performance - 1000 Skyline") {
 
   //dump(generate_image(sheets[0], sizes));
 }
+
+TEST_CASE("performance - Rotate", "[.benchmark]") {
+  auto source = Image(2048, 2048);
+  for (auto y = 0; y < source.height(); ++y)
+    for (auto x = 0; x < source.width(); ++x)
+      source.rgba_at({ x, y }).rgba = static_cast<uint32_t>(y * 4093 + x);
+  auto dest = Image(2048, 2048);
+
+  BENCHMARK("copy_rect_rotated_cw") {
+    copy_rect_rotated_cw(source, source.bounds(), dest, 0, 0);
+  };
+
+  // previous implementation, one pixel at a time
+  BENCHMARK("reference") {
+    const auto [w, h] = source.bounds().size();
+    for (auto y = 0; y < h; ++y)
+      for (auto x = 0; x < w; ++x)
+        std::memcpy(
+          dest.rgba() + (x * dest.width() + (h-1 - y)),
+          source.rgba() + (y * source.width() + x),
+          sizeof(RGBA));
+  };
+}
+
+TEST_CASE("performance - Compact", "[.benchmark]") {
+  auto sheet = std::make_shared<Sheet>();
+  sheet->pack = Pack::compact;
+  sheet->shape_padding = 1;
+  sheet->max_width = 256;
+  sheet->max_height = 256;
+  const auto generated = generate_convex_sprites(sheet, 400);
+
+  auto sprites = generated;
+  auto slices = std::vector<Slice>();
+  pack_compact(sheet, sprites, slices);
+  const auto area = get_total_area(slices);
+
+  auto reference_sprites = generated;
+  auto reference_slices = std::vector<Slice>();
+  pack_binpack(sheet, reference_sprites, reference_slices, true);
+  for (auto& slice : reference_slices) {
+    recompute_slice_size(slice);
+    compact_sprites_fixed_steps(slice, sheet->border_padding, sheet->shape_padding);
+  }
+  const auto reference_area = get_total_area(reference_slices);
+  WARN("area: " << area << ", reference: " << reference_area);
+  CHECK(area <= reference_area);
+
+  BENCHMARK("pack_compact") {
+    auto sprites = generated;
+    auto slices = std::vector<Slice>();
+    pack_compact(sheet, sprites, slices);
+    return slices.size();
+  };
+
+  BENCHMARK("reference") {
+    auto sprites = generated;
+    auto slices = std::vector<Slice>();
+    pack_binpack(sheet, sprites, slices, true);
+    for (auto& slice : slices) {
+      recompute_slice_size(slice);
+      compact_sprites_fixed_steps(slice, sheet->border_padding, sheet->shape_padding);
+    }
+    return slices.size();
+  };
+}
+
+TEST_CASE("performance - Nest", "[.benchmark]") {
+  auto sheet = std::make_shared<Sheet>();
+  sheet->shape_padding = 1;
+  sheet->max_width = 256;
+  sheet->max_height = 256;
+  const auto generated = generate_convex_sprites(sheet, 400);
+
+  auto sprites = generated;
+  auto slices = std::vector<Slice>();
+  pack_nest(sheet, sprites, slices);
+  const auto area = get_total_area(slices);
+
+  auto reference_sprites = generated;
+  auto reference_slices = std::vector<Slice>();
+  pack_compact(sheet, reference_sprites, reference_slices);
+  const auto reference_area = get_total_area(reference_slices);
+  WARN("area: " << area << ", reference: " << reference_area);
+  CHECK(area <= reference_area);
+
+  BENCHMARK("pack_nest") {
+    auto sprites = generated;
+    auto slices = std::vector<Slice>();
+    pack_nest(sheet, sprites, slices);
+    return slices.size();
+  };
+
+  BENCHMARK("reference") {
+    auto sprites = generated;
+    auto slices = std::vector<Slice>();
+    pack_compact(sheet, sprites, slices);
+    return slices.size();
+  };
+}